@@ -0,0 +1,25 @@
+Hoarder = Script("Hoarder", function(size)
+    local cells = {}
+
+    for i = 1, size do
+        cells[i] = i
+    end
+
+    return { cells = cells, handled = 0 }
+end)
+
+-- Walk every cell `passes' times, so the handler is bound by memory rather
+-- than by CPU
+function Hoarder:churn (passes)
+    local cells = self.cells
+
+    for p = 1, passes do
+        for i = 1, #cells do
+            cells[i] = cells[i] + p
+        end
+    end
+
+    self.handled = self.handled + 1
+end
+
+return Hoarder
@@ -0,0 +1,17 @@
+Pinger = Script("Pinger", function(limit)
+    return { hops = 0, limit = limit, done = false }
+end)
+
+-- Bounce the ball back to whoever sent it until we've seen `limit' of them
+function Pinger:ping (author)
+    self.hops = self.hops + 1
+
+    if self.hops >= self.limit then
+        self.done = true
+        return
+    end
+
+    actor:whisper(author, {"ping"})
+end
+
+return Pinger
@@ -0,0 +1,17 @@
+Spinner = Script("Spinner", function()
+    return { handled = 0, sum = 0 }
+end)
+
+-- Burn `n' iterations of CPU to stand in for a handler doing real work
+function Spinner:work (n)
+    local sum = 0
+
+    for i = 1, n do
+        sum = sum + i % 7
+    end
+
+    self.sum = self.sum + sum
+    self.handled = self.handled + 1
+end
+
+return Spinner
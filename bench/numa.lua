@@ -0,0 +1,45 @@
+--
+-- Locality benchmark: every Actor holds a large table and each message walks
+-- all of it. When Workers migrate between cores (or sockets) the tables have
+-- to follow them through the caches and across NUMA nodes. Compare run times
+-- with and without `-a' through `make bench' on a multi-socket machine.
+--
+
+local actors = 16
+local messages = 32
+local size, passes = 65536, 4
+
+function wait(n)
+    os.execute("sleep " .. tonumber(n))
+end
+
+function handled(a)
+    local ok, n = pcall(a.probe, a, 1, "handled")
+    return ok and n or -1
+end
+
+local cast = {}
+
+for i = 1, actors do
+    cast[i] = Actor{ {"Hoarder", size} }
+end
+
+for i = 1, actors do
+    while handled(cast[i]) < 0 do
+        wait(0.01)
+    end
+end
+
+for m = 1, messages do
+    for i = 1, actors do
+        cast[i]:async("send", {"churn", passes})
+    end
+end
+
+for i = 1, actors do
+    while handled(cast[i]) < messages do
+        wait(0.01)
+    end
+end
+
+print(string.format("%d walks of %d cells", actors * messages, size))
@@ -0,0 +1,31 @@
+--
+-- Latency benchmark: two Actors whisper a single message back and forth. Only
+-- one Action is ever in flight, so the run time is the sum of every hop's
+-- dispatch latency. Run it through `make bench' which times the whole run.
+--
+
+local round_trips = 10000
+
+function wait(n)
+    os.execute("sleep " .. tonumber(n))
+end
+
+function loaded(a)
+    return pcall(a.probe, a, 1, "hops")
+end
+
+local ping = Actor{ {"Pinger", round_trips} }
+local pong = Actor{ {"Pinger", round_trips} }
+
+while not (loaded(ping) and loaded(pong)) do
+    wait(0.01)
+end
+
+ping:whisper(pong, {"ping"})
+
+while not (ping:probe(1, "done") or pong:probe(1, "done")) do
+    wait(0.01)
+end
+
+print(string.format("%d round trips (%d hops) between two actors",
+    round_trips, ping:probe(1, "hops") + pong:probe(1, "hops")))
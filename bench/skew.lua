@@ -0,0 +1,46 @@
+--
+-- Throughput benchmark under skewed load: many Actors get `work' messages and
+-- every eighth message is far heavier than the rest. Workers that draw the
+-- heavy messages fall behind, so this measures how well idle Workers pick up
+-- the slack. Compare run times with different `-w' through `make bench'.
+--
+
+local actors = 32
+local messages = 64
+local light, heavy = 1000, 200000
+
+function wait(n)
+    os.execute("sleep " .. tonumber(n))
+end
+
+function handled(a)
+    local ok, n = pcall(a.probe, a, 1, "handled")
+    return ok and n or -1
+end
+
+local cast = {}
+
+for i = 1, actors do
+    cast[i] = Actor{ {"Spinner"} }
+end
+
+for i = 1, actors do
+    while handled(cast[i]) < 0 do
+        wait(0.01)
+    end
+end
+
+for m = 1, messages do
+    for i = 1, actors do
+        local n = ((m * actors + i) % 8 == 0) and heavy or light
+        cast[i]:async("send", {"work", n})
+    end
+end
+
+for i = 1, actors do
+    while handled(cast[i]) < messages do
+        wait(0.01)
+    end
+end
+
+print(string.format("%d messages across %d actors", actors * messages, actors))
@@ -10,7 +10,7 @@ require 'busted.runner'()
 --
 
 function wait(n)
-    -- we use sleep to wait for asynchronous actions to occur
+    -- only for tests about time, `Director.wait_idle' waits for Actions
     os.execute("sleep " .. tonumber(n))
 end
 
@@ -32,7 +32,7 @@ describe("The Director", function()
         --  1  2  5
         --    / \
         --   3   4
-        wait(1)
+        Director.wait_idle()
     end)
 
     teardown(function()
@@ -56,7 +56,8 @@ describe("The Director", function()
     end)
 
     after_each(function()
-        -- reset the tree
+        -- reset the tree once whatever the test sent has been handled
+        Director.wait_idle()
         a0:load("all")
         a1:load("all")
         a2:load("all")
@@ -69,21 +70,45 @@ describe("The Director", function()
         assert.is_equal(a0:probe(1, "string"), "root")
         -- a0:send{"name_is", "tim"}
         Director{a0, "send", {"name_is", "head"}}
-        wait(0.25)
+        Director.wait_idle()
         assert.is_equal(a0:probe(1, "string"), "head")
     end)
 
+    it("calls the same handler by the Actor's id or any method", function()
+        -- `send' is called directly, `think' is looked up on the Actor
+        Director{a0:id(), "send", {"increment_by", 2}}
+        Director{a0, "think", {"increment_by", 3}}
+        a0:async("send", {"increment_by", 4})
+        Director.wait_idle()
+        assert.is_equal(a0:probe(1, "numeral"), 9)
+    end)
+
     it("is the handler the `async' method", function()
         assert.is_equal(a0:probe(1, "string"), "root")
         a0:async("send", {"name_is", "head"})
-        wait(0.25)
+        Director.wait_idle()
+        assert.is_equal(a0:probe(1, "string"), "head")
+    end)
+
+    it("takes Actions with a priority through `async_priority'", function()
+        assert.is_equal(a0:probe(1, "string"), "root")
+        for i = 1, 50 do
+            a0:async("send", {"increment_by", 1})
+        end
+        a0:async_priority("high", "send", {"name_is", "head"})
+        Director.wait_idle()
         assert.is_equal(a0:probe(1, "string"), "head")
+        assert.is_equal(a0:probe(1, "numeral"), 50)
+
+        assert.has_error(function()
+            a0:async_priority("urgent", "send", {"name_is", "root"})
+        end)
     end)
 
     it("does not supply author information on its own through `async'", function()
         assert.is_equal(a5:probe(1, "string"), "five")
         a5:async("send", {"name_is", "leaf"})
-        wait(0.25)
+        Director.wait_idle()
         assert.is_equal(a5:probe(1, "string"), "leaf")
         assert.is_equal(a5:probe(1, "last_author"), nil)
     end)
@@ -92,14 +117,14 @@ describe("The Director", function()
         -- think
         assert.is_equal(a0:probe(1, "string"), "root")
         a0:think{"name_is", "head"}
-        wait(0.25)
+        Director.wait_idle()
         assert.is_equal(a0:probe(1, "last_author"), 0)
         assert.is_equal(a0:probe(1, "string"), "head")
 
         -- whisper
         assert.is_equal(a0:probe(1, "string"), "head")
         a1:whisper(a0, {"name_is", "root"})
-        wait(0.25)
+        Director.wait_idle()
         assert.is_equal(a0:probe(1, "last_author"), 1)
         assert.is_equal(a0:probe(1, "string"), "root")
 
@@ -111,7 +136,7 @@ describe("The Director", function()
         assert.is_equal(a4:probe(1, "numeral"), 4)
         assert.is_equal(a5:probe(1, "numeral"), 5)
         a0:yell{"increment_by", 10}
-        wait(0.50)
+        Director.wait_idle()
         assert.is_equal(a0:probe(1, "last_author"), 0)
         assert.is_equal(a1:probe(1, "last_author"), 0)
         assert.is_equal(a2:probe(1, "last_author"), 0)
@@ -130,7 +155,7 @@ describe("The Director", function()
         assert.is_equal(a3:probe(1, "numeral"), 13)
         assert.is_equal(a4:probe(1, "numeral"), 14)
         a2:command{"increment_by", 10}
-        wait(0.50)
+        Director.wait_idle()
         assert.is_equal(a2:probe(1, "last_author"), 2)
         assert.is_equal(a3:probe(1, "last_author"), 2)
         assert.is_equal(a4:probe(1, "last_author"), 2)
@@ -144,7 +169,7 @@ describe("The Director", function()
         assert.is_equal(a2:probe(1, "numeral"), 22)
         assert.is_equal(a5:probe(1, "numeral"), 15)
         a2:say{"increment_by", 10}
-        wait(0.50)
+        Director.wait_idle()
         assert.is_equal(a2:probe(1, "last_author"), 2)
         assert.is_equal(a3:probe(1, "last_author"), 2)
         assert.is_equal(a4:probe(1, "last_author"), 2)
@@ -154,6 +179,296 @@ describe("The Director", function()
         assert.is_equal(a5:probe(1, "numeral"), 25)
     end)
 
+    it("handles messages from one sender in the order they were sent", function()
+        assert.is_equal(a0:probe(1, "string"), "root")
+        for i = 1, 100 do
+            a1:whisper(a0, {"name_is", "name" .. i})
+        end
+        Director.wait_idle()
+        assert.is_equal(a0:probe(1, "last_author"), 1)
+        assert.is_equal(a0:probe(1, "string"), "name100")
+    end)
+
+    it("runs each Actor's Actions one at a time in the order they arrived", function()
+        local expected = {}
+        for i = 1, 200 do
+            expected[i] = i
+            a3:async("send", {"push", i})
+        end
+        Director.wait_idle()
+        assert.are_same(a3:probe(1, "table"), expected)
+    end)
+
+    it("counts what happened to Actions sent to full mailboxes", function()
+        local overflow = Director.overflow()
+        assert.is_equal(type(overflow.blocked), "number")
+        assert.is_equal(type(overflow.rejected), "number")
+        assert.is_equal(type(overflow.dropped_newest), "number")
+        assert.is_equal(type(overflow.dropped_oldest), "number")
+    end)
+
+    it("sends Actions after a delay and can cancel them", function()
+        assert.is_equal(a0:probe(1, "string"), "root")
+        a0:after(100, {"name_is", "later"})
+        local handle = a0:after(100, {"increment_by", 10})
+        assert.is_true(Director.cancel(handle))
+        assert.is_false(Director.cancel(handle))
+        assert.is_equal(a0:probe(1, "string"), "root")
+        Director.wait_idle()
+        assert.is_equal(a0:probe(1, "last_author"), 0)
+        assert.is_equal(a0:probe(1, "string"), "later")
+        assert.is_equal(a0:probe(1, "numeral"), 0)
+    end)
+
+    it("sends Actions periodically with `Director.timed'", function()
+        assert.is_equal(a0:probe(1, "numeral"), 0)
+        local handle = Director.timed(20, 1000, {a0, "send", {"increment_by", 1}})
+        wait(0.50)
+        assert.is_true(Director.cancel(handle))
+        Director.wait_idle()
+        local numeral = a0:probe(1, "numeral")
+        assert.is_true(numeral >= 8 and numeral <= 11)
+        wait(0.20)
+        assert.is_equal(a0:probe(1, "numeral"), numeral)
+    end)
+
+    it("can grow and shrink its pool of Workers while running", function()
+        local count = Director.workers()
+        assert.is_equal(Director.workers(count + 2), count + 2)
+        assert.is_equal(Director.workers(1), 1)
+
+        assert.is_equal(a0:probe(1, "numeral"), 0)
+        for i = 1, 20 do
+            a0:async("send", {"increment_by", 1})
+        end
+        Director.wait_idle()
+        assert.is_equal(a0:probe(1, "numeral"), 20)
+
+        -- the removed Workers were stopped, growing restarts them
+        assert.is_equal(Director.workers(count), count)
+        for i = 1, 20 do
+            a0:async("send", {"increment_by", 1})
+        end
+        assert.is_true(Director.wait_idle(1000))
+        assert.is_equal(a0:probe(1, "numeral"), 40)
+    end)
+
+    it("keeps statistics of what each Worker has done", function()
+        local before = Director.stats().total.processed
+        for i = 1, 10 do
+            a0:async("send", {"increment_by", 1})
+        end
+        Director.wait_idle()
+
+        local stats = Director.stats()
+        assert.is_true(stats.uptime > 0)
+        assert.is_equal(#stats.workers, stats.pool)
+        assert.is_true(stats.total.processed >= before + 10)
+        assert.is_true(stats.total.wait.count >= 10)
+        assert.is_true(stats.total.handler.p50 <= stats.total.handler.max)
+        assert.is_equal(type(stats.workers[1].depth), "number")
+        assert.is_equal(type(stats.overflow.rejected), "number")
+    end)
+
+    it("counts the Actions queued for an Actor in its Worker's depth", function()
+        local function depth ()
+            local sum = 0
+            for _, worker in ipairs(Director.stats().workers) do
+                sum = sum + worker.depth
+            end
+            return sum
+        end
+        -- the pushes wait in a1's queue behind the spin
+        a1:async("send", {"spin", 100, 1})
+        for i = 1, 5 do
+            a1:async("send", {"push", i})
+        end
+        assert.is_true(depth() >= 5)
+        Director.wait_idle()
+        assert.is_equal(depth(), 0)
+    end)
+
+    it("keeps Actors of a named pool on that pool's own Workers", function()
+        assert.is_nil(Director.pool("render"))
+        assert.is_equal(Director.pool("render", 1, "normal"), 1)
+        assert.is_equal(Director.pool("render"), 1)
+        assert.has_error(function() Director.pool("render", 1) end)
+        assert.has_error(function()
+            a0:child({ {"test-script", "none", 0, {}} }, "missing")
+        end)
+
+        local before = Director.stats().total.processed
+        local renderer = a0:child({ {"test-script", "render", 0, {}} }, 
+            "render")
+        for i = 1, 10 do
+            renderer:async("send", {"increment_by", 1})
+        end
+        Director.wait_idle()
+
+        local stats = Director.stats()
+        assert.is_equal(renderer:probe(1, "numeral"), 10)
+        assert.is_true(stats.pools.render[1].processed >= 10)
+        assert.is_true(stats.total.processed >= before + 10)
+        assert.is_equal(#stats.workers, stats.pool)
+        renderer:remove()
+    end)
+
+    it("keeps Actors which message themselves from starving others", function()
+        -- on a single Worker only the turns of handler time keep a0 from
+        -- crowding out a1 and a3, a turn of 16 spins would take 320 ms
+        local count = Director.workers()
+        local one, three
+        assert.is_equal(Director.workers(1), 1)
+        a0:async("send", {"spin", 20, 25})
+        for i = 1, 10 do
+            a1:async("send", {"increment_by", 1})
+            a3:async("send", {"increment_by", 1})
+        end
+        wait(0.10)
+        one = a1:probe(1, "numeral")
+        three = a3:probe(1, "numeral")
+        Director.wait_idle()
+        Director.workers(count)
+        assert.is_equal(one, 11)
+        assert.is_equal(three, 13)
+    end)
+
+    it("skips stale copies of messages an Actor coalesces", function()
+        local before = Director.stats().total.coalesced
+        -- a1's Worker is busy while the copies pile up in a1's queue
+        a1:async("send", {"spin", 100, 1})
+        for i = 1, 10 do
+            a1:async("send", {"latest", i})
+        end
+        Director.wait_idle()
+        assert.are_same(a1:probe(1, "table"), {10})
+        assert.is_equal(Director.stats().total.coalesced, before + 9)
+    end)
+
+    it("drops expired messages and handles the earliest deadline first", function()
+        local before = Director.stats().total.expired
+        -- everything queues behind the spin, the first message expires there
+        a1:async("send", {"spin", 100, 1})
+        a1:send_by(20, {"push", 1})
+        a1:async("send", {"push", 2})
+        a1:send_by(500, {"push", 3})
+        Director{ {a1, "send", {"push", 4}, ttl = 300} }
+        Director.wait_idle()
+        assert.are_same(a1:probe(1, "table"), {4, 3, 2})
+        assert.is_equal(Director.stats().total.expired, before + 1)
+    end)
+
+    it("holds the Actions sent in `Director.batch' until it returns", function()
+        local held
+        local sent = Director.batch(function (n)
+            for i = 1, n do
+                a1:async("send", {"push", i})
+            end
+            wait(0.05)
+            held = #a1:probe(1, "table")
+            return n
+        end, 5)
+        assert.is_equal(sent, 5)
+        assert.is_equal(held, 0)
+        Director.wait_idle()
+        assert.are_same(a1:probe(1, "table"), {1, 2, 3, 4, 5})
+    end)
+
+    it("refuses to yield inside `Director.batch'", function()
+        local batch = coroutine.wrap(function ()
+            return Director.batch(function ()
+                a1:async("send", {"push", 1})
+                coroutine.yield()
+                a1:async("send", {"push", 2})
+            end)
+        end)
+        assert.has_error(batch)
+        -- the batch is over, what was sent before the yield still goes
+        a1:async("send", {"push", 3})
+        assert.is_true(Director.wait_idle(1000))
+        assert.are_same(a1:probe(1, "table"), {1, 3})
+    end)
+
+    it("waits until every Action and what it sent has been handled", function()
+        a1:async("send", {"spin", 100, 1})
+        assert.is_false(Director.wait_idle(10))
+        a2:think{"proxy", "command", {"increment_by", 1}}
+        assert.is_true(Director.wait_idle())
+        assert.is_equal(a3:probe(1, "numeral"), 4)
+        assert.is_equal(a4:probe(1, "numeral"), 5)
+        assert.has_error(function() Director.wait_idle("soon") end)
+    end)
+
+    it("handles in each superstep what was sent during the last", function()
+        Director.begin_steps()
+        a2:think{"proxy", "command", {"increment_by", 1}}
+        assert.is_equal(Director.step(), 1)
+        -- what a2 sent waits for the next step
+        assert.is_equal(a3:probe(1, "numeral"), 3)
+        assert.is_equal(Director.step(), 2)
+        assert.is_equal(a3:probe(1, "numeral"), 4)
+        assert.is_equal(a4:probe(1, "numeral"), 5)
+        assert.is_equal(Director.step(), 0)
+
+        -- each spin sends the next one, the fourth step has nothing to do
+        a1:async("send", {"spin", 1, 3})
+        assert.is_equal(Director.run_steps(10), 3)
+        a1:async("send", {"push", 1})
+        assert.is_equal(Director.end_steps(), 1)
+        Director.wait_idle()
+        assert.are_same(a1:probe(1, "table"), {1})
+        assert.has_error(function() Director.run_steps(-1) end)
+    end)
+
+    it("only pumps the main thread's Worker, which `-e' creates", function()
+        -- the specs run with `-s' alone, so every Worker has its own thread
+        assert.has_error(function() Director.pump(1) end)
+    end)
+
+    it("lets handlers sleep without blocking their Worker", function()
+        a1:async("send", {"nap", 200, false})
+        a1:async("send", {"increment_by", 5})
+        a3:async("send", {"increment_by", 5})
+        wait(0.10)
+        -- the handler holds back a1's messages, but not other Actors'
+        assert.is_equal(a1:probe(1, "numeral"), 1)
+        assert.is_equal(a3:probe(1, "numeral"), 8)
+        Director.wait_idle()
+        assert.is_equal(a1:probe(1, "numeral"), 7)
+
+        a1:async("send", {"nap", 200, true})
+        a1:async("send", {"increment_by", 5})
+        wait(0.10)
+        -- unless it allows messages to interleave with it
+        assert.is_equal(a1:probe(1, "numeral"), 12)
+        Director.wait_idle()
+        assert.is_equal(a1:probe(1, "numeral"), 13)
+    end)
+
+    it("lets handlers ask other Actors and wait for the answer", function()
+        a1:async("send", {"ask_for", a4:id()})
+        Director.wait_idle()
+        assert.are_same(a1:probe(1, "table"), {true, 4})
+
+        -- a late answer is ignored once the question timed out
+        a4:async("send", {"nap", 300, false})
+        a1:async("send", {"ask_for", a4:id(), 50})
+        wait(0.15)
+        assert.are_same(a1:probe(1, "table"), {false, "timeout"})
+        Director.wait_idle()
+        assert.are_same(a1:probe(1, "table"), {false, "timeout"})
+        assert.is_equal(a4:probe(1, "numeral"), 5)
+
+        -- only handlers can wait, anyone else needs a callback
+        assert.has_error(function() a4:ask({"get"}) end)
+    end)
+
+    it("cancels the timeout of a question once it is answered", function()
+        a1:async("send", {"ask_for", a4:id(), 5000})
+        assert.is_true(Director.wait_idle(1000))
+        assert.are_same(a1:probe(1, "table"), {true, 4})
+    end)
+
     it("allows for messages which send actions", function()
         assert.is_equal(a0:probe(1, "numeral"), 0)
         assert.is_equal(a1:probe(1, "numeral"), 1)
@@ -162,7 +477,7 @@ describe("The Director", function()
         assert.is_equal(a4:probe(1, "numeral"), 4)
         assert.is_equal(a5:probe(1, "numeral"), 5)
         a2:think{"proxy", "yell", {"increment_by", 5}}
-        wait(0.50)
+        Director.wait_idle()
         assert.is_equal(a0:probe(1, "last_author"), 2)
         assert.is_equal(a1:probe(1, "last_author"), 2)
         assert.is_equal(a2:probe(1, "last_author"), 2)
@@ -178,7 +493,7 @@ describe("The Director", function()
 
         -- relay
         a0:whisper(a2, {"proxy", "command", {"increment_by", 5}})
-        wait(0.50)
+        Director.wait_idle()
         assert.is_equal(a2:probe(1, "last_author"), 2)
         assert.is_equal(a3:probe(1, "last_author"), 2)
         assert.is_equal(a4:probe(1, "last_author"), 2)
@@ -0,0 +1,65 @@
+_G.arg = {}
+require 'busted.runner'()
+
+--
+-- This tests what each overflow policy does to Actions sent to a full queue.
+-- It is run once for each policy with a single Worker and a capacity of 4
+-- Actions per Actor, see the `test' target of the Makefile:
+--
+--   DIALOGUE_OVERFLOW=<policy> dialogue -s -w 1 -p 4 -o <policy> overflow.lua
+--
+
+local policy = os.getenv("DIALOGUE_OVERFLOW") or "block"
+
+function wait(n)
+    os.execute("sleep " .. tonumber(n))
+end
+
+describe("A full Actor queue with the `" .. policy .. "' policy", function()
+    local a0
+
+    setup(function()
+        a0 = Actor{ {"test-script", "root", 0, {}} }
+        Director.wait_idle()
+    end)
+
+    teardown(function()
+        a0:remove()
+    end)
+
+    it("keeps the right messages and counts the rest", function()
+        local before = Director.overflow()
+        local errors = 0
+
+        -- the Worker is busy with the Actor, which counts towards its 4
+        a0:async("send", {"spin", 300, 1})
+        wait(0.10)
+
+        for i = 1, 8 do
+            if not pcall(a0.async, a0, "send", {"push", i}) then
+                errors = errors + 1
+            end
+        end
+
+        Director.wait_idle()
+        local after = Director.overflow()
+
+        if policy == "block" then
+            assert.is_true(after.blocked > before.blocked)
+            assert.is_equal(errors, 0)
+            assert.are_same(a0:probe(1, "table"), {1, 2, 3, 4, 5, 6, 7, 8})
+        elseif policy == "reject" then
+            assert.is_equal(after.rejected - before.rejected, 5)
+            assert.is_equal(errors, 5)
+            assert.are_same(a0:probe(1, "table"), {1, 2, 3})
+        elseif policy == "drop-newest" then
+            assert.is_equal(after.dropped_newest - before.dropped_newest, 5)
+            assert.is_equal(errors, 0)
+            assert.are_same(a0:probe(1, "table"), {1, 2, 3})
+        elseif policy == "drop-oldest" then
+            assert.is_equal(after.dropped_oldest - before.dropped_oldest, 5)
+            assert.is_equal(errors, 0)
+            assert.are_same(a0:probe(1, "table"), {6, 7, 8})
+        end
+    end)
+end)
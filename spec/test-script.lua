@@ -7,6 +7,9 @@ Test = Script("Test", function(s, n, t)
     }
 end)
 
+-- stale copies of these are skipped when a newer one is queued
+Test.coalesce = {"latest"}
+
 function Test:increment_by (x, author)
     self.numeral = self.numeral + x
     self.last_author = author
@@ -26,6 +29,36 @@ function Test:proxy (tone, msg)
     actor[tone](actor, msg)
 end
 
+function Test:nap (ms, interleave)
+    actor:sleep(ms, interleave)
+    self.numeral = self.numeral + 1
+end
+
+function Test:spin (ms, times)
+    local stop = os.clock() + ms / 1000
+    while os.clock() < stop do end
+    if times > 1 then
+        actor:think{"spin", ms, times - 1}
+    end
+end
+
+function Test:push (x)
+    self.table[#self.table + 1] = x
+end
+
+function Test:latest (x)
+    self.table[#self.table + 1] = x
+end
+
+function Test:get ()
+    return self.numeral
+end
+
+function Test:ask_for (id, timeout)
+    local ok, answer = Actor(id):ask({"get"}, timeout)
+    self.table = {ok, answer}
+end
+
 function Test:io (str)
     io.write(str)
 end
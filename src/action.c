@@ -0,0 +1,443 @@
+#include <stdlib.h>
+#include <string.h>
+#include "action.h"
+
+#define ACTION_INITIAL_SIZE 64
+
+/* the most Actions a thread keeps for reuse, see `action_destroy' */
+#define ACTION_POOL_SIZE 256
+
+/* larger buffers are freed with their Action rather than kept */
+#define ACTION_POOL_BUFFER 1024
+
+/*
+ * The Actions a thread destroyed and makes its new ones from, linked through
+ * `next'. An Action is usually destroyed by another thread than the one
+ * which made it, so a thread which only handles Actions would keep every one
+ * it sees if there wasn't a limit.
+ */
+typedef struct ActionPool {
+    Action *first;
+    int count;
+} ActionPool;
+
+static __thread ActionPool action_pool = { NULL, 0 };
+
+/* the name of each method with a code, in the order of `enum ActionMethod' */
+static const char *action_methods[] = {
+    NULL, "send", "load", "unload", "resume", "answer", "callback"
+};
+
+/*
+ * Every serialized value starts with one of these tags. Tables are written as
+ * a TABLE tag, key and value pairs, and then a TABLE_END tag.
+ */
+enum ActionTag {
+    TAG_NIL, TAG_TRUE, TAG_FALSE, TAG_NUMBER, TAG_STRING, TAG_POINTER,
+    TAG_TABLE, TAG_TABLE_END
+};
+
+/*
+ * Append `length' bytes to the Action's buffer, growing it when needed.
+ * Returns 0 if successful, 1 if there wasn't enough memory.
+ */
+static int
+action_write (Action *action, const void *bytes, const size_t length)
+{
+    size_t size = action->size;
+    char *memory = NULL;
+
+    if (action->length + length > size) {
+        while (action->length + length > size)
+            size *= 2;
+
+        memory = realloc(action->data, size);
+
+        if (!memory)
+            return 1;
+
+        action->data = memory;
+        action->size = size;
+    }
+
+    memcpy(action->data + action->length, bytes, length);
+    action->length += length;
+    return 0;
+}
+
+static inline int
+action_write_tag (Action *action, const char tag)
+{
+    return action_write(action, &tag, 1);
+}
+
+/*
+ * Write the value at index of L to the end of the Action's buffer.
+ * Returns 0 if successful, 1 if there wasn't enough memory.
+ */
+static int
+action_serialize (Action *action, lua_State *L, int index)
+{
+    const char *string = NULL;
+    lua_Number number;
+    size_t length;
+    void *pointer;
+    int ret = 1;
+
+    index = lua_absindex(L, index);
+
+    switch (lua_type(L, index)) {
+    case LUA_TNUMBER:
+        number = lua_tonumber(L, index);
+        if (action_write_tag(action, TAG_NUMBER) 
+                || action_write(action, &number, sizeof(number)))
+            goto exit;
+        break;
+
+    case LUA_TSTRING:
+        string = lua_tolstring(L, index, &length);
+        if (action_write_tag(action, TAG_STRING) 
+                || action_write(action, &length, sizeof(length))
+                || action_write(action, string, length))
+            goto exit;
+        break;
+
+    case LUA_TBOOLEAN:
+        if (action_write_tag(action, 
+                    lua_toboolean(L, index) ? TAG_TRUE : TAG_FALSE))
+            goto exit;
+        break;
+
+    case LUA_TUSERDATA:
+    case LUA_TLIGHTUSERDATA:
+        pointer = lua_touserdata(L, index);
+        if (action_write_tag(action, TAG_POINTER)
+                || action_write(action, &pointer, sizeof(pointer)))
+            goto exit;
+        break;
+
+    case LUA_TTABLE:
+        if (action_write_tag(action, TAG_TABLE))
+            goto exit;
+
+        luaL_checkstack(L, 2, "Action nested too deeply!");
+        lua_pushnil(L);
+        while (lua_next(L, index)) {
+            if (action_serialize(action, L, -2) 
+                    || action_serialize(action, L, -1)) {
+                lua_pop(L, 2); /* key and value */
+                goto exit;
+            }
+            lua_pop(L, 1); /* value */
+        }
+
+        if (action_write_tag(action, TAG_TABLE_END))
+            goto exit;
+        break;
+
+    default:
+        if (action_write_tag(action, TAG_NIL))
+            goto exit;
+        break;
+    }
+
+    ret = 0;
+exit:
+    return ret;
+}
+
+/*
+ * Push the value at the cursor onto L and move the cursor past it.
+ */
+static void
+action_deserialize (lua_State *L, const char **cursor)
+{
+    const char tag = **cursor;
+    lua_Number number;
+    size_t length;
+    void *pointer;
+
+    (*cursor)++;
+
+    switch (tag) {
+    case TAG_NUMBER:
+        memcpy(&number, *cursor, sizeof(number));
+        *cursor += sizeof(number);
+        lua_pushnumber(L, number);
+        break;
+
+    case TAG_STRING:
+        memcpy(&length, *cursor, sizeof(length));
+        *cursor += sizeof(length);
+        lua_pushlstring(L, *cursor, length);
+        *cursor += length;
+        break;
+
+    case TAG_TRUE:
+    case TAG_FALSE:
+        lua_pushboolean(L, tag == TAG_TRUE);
+        break;
+
+    case TAG_POINTER:
+        memcpy(&pointer, *cursor, sizeof(pointer));
+        *cursor += sizeof(pointer);
+        lua_pushlightuserdata(L, pointer);
+        break;
+
+    case TAG_TABLE:
+        luaL_checkstack(L, 3, "Action nested too deeply!");
+        lua_newtable(L);
+        while (**cursor != TAG_TABLE_END) {
+            action_deserialize(L, cursor); /* key */
+            action_deserialize(L, cursor); /* value */
+            lua_rawset(L, -3);
+        }
+        (*cursor)++;
+        break;
+
+    default:
+        lua_pushnil(L);
+        break;
+    }
+}
+
+/*
+ * Take an Action with an empty buffer from the calling thread's pool, or
+ * allocate one with a buffer of the initial size if the pool is empty.
+ */
+static Action *
+action_new ()
+{
+    Action *action = action_pool.first;
+
+    if (action) {
+        action_pool.first = action->next;
+        action_pool.count--;
+        goto reset;
+    }
+
+    action = malloc(sizeof(*action));
+
+    if (!action)
+        goto exit;
+
+    action->data = malloc(ACTION_INITIAL_SIZE);
+
+    if (!action->data) {
+        free(action);
+        action = NULL;
+        goto exit;
+    }
+
+    action->size = ACTION_INITIAL_SIZE;
+
+reset:
+    action->next = NULL;
+    action->actor = -1;
+    action->priority = ACTION_NORMAL;
+    action->method = ACTION_CALL;
+    action->count = 0;
+    action->coalesce = -1;
+    action->worker = -1;
+    action->sent = 0;
+    action->ttl = 0;
+    action->length = 0;
+
+exit:
+    return action;
+}
+
+/*
+ * Serialize the value at index of L into a new Action. Numbers, strings,
+ * booleans, light userdata and tables (recursively) are kept, anything else
+ * becomes `nil'. Metatables are not kept. Does not pop the value.
+ *
+ * Returns NULL if there wasn't enough memory.
+ */
+Action *
+action_create (lua_State *L, int index)
+{
+    return action_create_values(L, index, 1);
+}
+
+/*
+ * Serialize the `count' values from index of L into a new Action, one after
+ * the other, like `action_create'. Does not pop the values.
+ *
+ * Returns NULL if there wasn't enough memory.
+ */
+Action *
+action_create_values (lua_State *L, int index, const int count)
+{
+    Action *action = action_new();
+    int i;
+
+    if (!action)
+        goto exit;
+
+    index = lua_absindex(L, index);
+
+    for (i = 0; i < count; i++) {
+        if (action_serialize(action, L, index + i) != 0) {
+            action_destroy(action);
+            action = NULL;
+            goto exit;
+        }
+    }
+
+    action->count = count;
+
+exit:
+    return action;
+}
+
+/*
+ * Returns the code of the method with the name, ACTION_CALL if it has none.
+ */
+int
+action_method (const char *name)
+{
+    int i;
+
+    for (i = ACTION_SEND; i <= ACTION_CALLBACK; i++)
+        if (strcmp(action_methods[i], name) == 0)
+            return i;
+
+    return ACTION_CALL;
+}
+
+/*
+ * Create an Action that pushes a single `nil'. Workers use it as a sentinel.
+ * Returns NULL if there wasn't enough memory.
+ */
+Action *
+action_create_empty ()
+{
+    Action *action = action_new();
+
+    if (action) {
+        action_write_tag(action, TAG_NIL);
+        action->count = 1;
+    }
+
+    return action;
+}
+
+/*
+ * Returns 1 (true) if the Action holds nothing but `nil', like the sentinel.
+ */
+int
+action_is_empty (Action *action)
+{
+    return action->length == 1 && action->data[0] == TAG_NIL;
+}
+
+/*
+ * Push the value held by the Action onto L. The Action is unchanged and can
+ * be pushed again.
+ */
+void
+action_push (Action *action, lua_State *L)
+{
+    const char *cursor = action->data;
+    action_deserialize(L, &cursor);
+}
+
+/*
+ * Push every value held by the Action onto L, in order, and return how many
+ * there are. The Action is unchanged.
+ */
+int
+action_push_values (Action *action, lua_State *L)
+{
+    const char *cursor = action->data;
+    int i;
+
+    luaL_checkstack(L, action->count, "Action has too many values!");
+
+    for (i = 0; i < action->count; i++)
+        action_deserialize(L, &cursor);
+
+    return action->count;
+}
+
+/*
+ * When the Action is no longer worth handling, see `stats_now'. Returns
+ * UINT64_MAX if it has no time to live, meaning it is always handled.
+ */
+uint64_t
+action_deadline (Action *action)
+{
+    if (action->ttl == 0)
+        return UINT64_MAX;
+
+    return action->sent + action->ttl;
+}
+
+/*
+ * Create a copy of the Action, including the Actor, priority, coalescing
+ * slot and time to live it was given.
+ * Returns NULL if there wasn't enough memory.
+ */
+Action *
+action_copy (Action *action)
+{
+    Action *copy = action_new();
+
+    if (!copy)
+        goto exit;
+
+    if (action_write(copy, action->data, action->length) != 0) {
+        action_destroy(copy);
+        copy = NULL;
+        goto exit;
+    }
+
+    copy->actor = action->actor;
+    copy->priority = action->priority;
+    copy->method = action->method;
+    copy->count = action->count;
+    copy->coalesce = action->coalesce;
+    copy->sent = action->sent;
+    copy->ttl = action->ttl;
+
+exit:
+    return copy;
+}
+
+/*
+ * Destroy the Action. The calling thread keeps it for its next new Action
+ * unless it already keeps enough of them, then it is freed.
+ */
+void
+action_destroy (Action *action)
+{
+    if (action_pool.count < ACTION_POOL_SIZE 
+            && action->size <= ACTION_POOL_BUFFER) {
+        action->next = action_pool.first;
+        action_pool.first = action;
+        action_pool.count++;
+        return;
+    }
+
+    free(action->data);
+    free(action);
+}
+
+/*
+ * Free the Actions the calling thread keeps. A thread which made or
+ * destroyed Actions calls this before it exits.
+ */
+void
+action_pool_clear ()
+{
+    Action *action = NULL;
+
+    while ((action = action_pool.first)) {
+        action_pool.first = action->next;
+        free(action->data);
+        free(action);
+    }
+
+    action_pool.count = 0;
+}
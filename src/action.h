@@ -0,0 +1,147 @@
+/*============================================================================/
+
+    An Action is a serialized object call: a Lua table whose first element is
+  the actor and whose second element is the method. Elements 3+ are arguments
+  to that method.
+
+  The methods Actions call most, like `send', are known by a code instead.
+  Those Actions hold the actor and the arguments one after the other without
+  a table around them, so a Worker calls the method's function with them
+  directly rather than building the table and looking the method up.
+
+  Actions have to cross from the Lua state that made them into the state of
+  whichever Worker handles them. Rather than building a copy of the table in
+  an intermediate Lua state, the table is flattened into a plain byte buffer
+  owned by C. That buffer can be handed between threads freely and is pushed
+  back into a real Lua table only once it reaches the Worker.
+
+  The `next' member is an intrusive link so an Action can sit in a Mailbox
+  without any other allocation. Each thread keeps the Actions it destroys, up
+  to a limit, and makes its new Actions from them, buffers included.
+
+  An Action may have a time to live, after which it is no longer worth
+  handling. Its deadline is that long after it was sent.
+
+/============================================================================*/
+
+#ifndef DIALOGUE_ACTION
+#define DIALOGUE_ACTION
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dialogue.h"
+
+/*
+ * Actions with a high priority (the lifecycle methods like `load' and
+ * `unload') skip ahead of every normal Action queued for the Worker.
+ */
+enum ActionPriority {
+    ACTION_NORMAL, ACTION_HIGH
+};
+
+/*
+ * The methods of an Actor an Action can call by code, see `action_method'.
+ * ACTION_CALL is any other, whose Action holds the whole table.
+ */
+enum ActionMethod {
+    ACTION_CALL, ACTION_SEND, ACTION_LOAD, ACTION_UNLOAD, ACTION_RESUME,
+    ACTION_ANSWER, ACTION_CALLBACK
+};
+
+typedef struct Action {
+    struct Action *next;
+    int actor; /* id of the Actor it is for, -1 if not known */
+    int priority;
+    int method; /* see `enum ActionMethod' */
+    int count; /* how many values it holds */
+    int coalesce; /* the Actor's coalescing slot of its message, -1 if none */
+    int worker; /* the Worker it's counted as queued for, -1 if none */
+    uint64_t sent; /* when it was given to a Worker, see `stats_now' */
+    uint64_t ttl; /* how long (ns) after being sent it's worth handling */
+    char *data;
+    size_t length;
+    size_t size;
+} Action;
+
+/*
+ * Serialize the value at index of L into a new Action. Numbers, strings,
+ * booleans, light userdata and tables (recursively) are kept, anything else
+ * becomes `nil'. Metatables are not kept. Does not pop the value.
+ *
+ * Returns NULL if there wasn't enough memory.
+ */
+Action *
+action_create (lua_State *L, int index);
+
+/*
+ * Serialize the `count' values from index of L into a new Action, one after
+ * the other, like `action_create'. Does not pop the values.
+ *
+ * Returns NULL if there wasn't enough memory.
+ */
+Action *
+action_create_values (lua_State *L, int index, const int count);
+
+/*
+ * Returns the code of the method with the name, ACTION_CALL if it has none.
+ */
+int
+action_method (const char *name);
+
+/*
+ * Create an Action that pushes a single `nil'. Workers use it as a sentinel.
+ * Returns NULL if there wasn't enough memory.
+ */
+Action *
+action_create_empty ();
+
+/*
+ * Returns 1 (true) if the Action holds nothing but `nil', like the sentinel.
+ */
+int
+action_is_empty (Action *action);
+
+/*
+ * Push the value held by the Action onto L. The Action is unchanged and can
+ * be pushed again.
+ */
+void
+action_push (Action *action, lua_State *L);
+
+/*
+ * Push every value held by the Action onto L, in order, and return how many
+ * there are. The Action is unchanged.
+ */
+int
+action_push_values (Action *action, lua_State *L);
+
+/*
+ * When the Action is no longer worth handling, see `stats_now'. Returns
+ * UINT64_MAX if it has no time to live, meaning it is always handled.
+ */
+uint64_t
+action_deadline (Action *action);
+
+/*
+ * Create a copy of the Action, including the Actor, priority, coalescing
+ * slot and time to live it was given.
+ * Returns NULL if there wasn't enough memory.
+ */
+Action *
+action_copy (Action *action);
+
+/*
+ * Destroy the Action. The calling thread keeps it for its next new Action
+ * unless it already keeps enough of them, then it is freed.
+ */
+void
+action_destroy (Action *action);
+
+/*
+ * Free the Actions the calling thread keeps. A thread which made or
+ * destroyed Actions calls this before it exits.
+ */
+void
+action_pool_clear ();
+
+#endif
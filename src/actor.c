@@ -4,6 +4,8 @@
 #include "actor.h"
 #include "script.h"
 #include "company.h"
+#include "director.h"
+#include "tree.h"
 #include "utils.h"
 
 struct Actor {
@@ -11,10 +13,36 @@ struct Actor {
     Script *script_head;
     Script *script_tail;
     int id;
+
+    /* handlers which yielded, see `actor_send' */
+    int suspended_ref; /* suspended handlers by token */
+    int deferred_ref; /* messages waiting for exclusive handlers to finish */
+    int deferred_first;
+    int deferred_last;
+    int exclusive; /* suspended handlers which don't allow interleaving */
+    int next_token;
 };
 
 void actor_add_script (Actor *actor, Script *script);
 
+/*
+ * Start with no suspended handlers or deferred messages. Tokens keep counting
+ * up so resumes for handlers which were forgotten are ignored.
+ */
+static void
+actor_reset_suspended (Actor *actor)
+{
+    lua_State *A = actor->L;
+
+    lua_newtable(A);
+    actor->suspended_ref = luaL_ref(A, LUA_REGISTRYINDEX);
+    lua_newtable(A);
+    actor->deferred_ref = luaL_ref(A, LUA_REGISTRYINDEX);
+    actor->deferred_first = 1;
+    actor->deferred_last = 0;
+    actor->exclusive = 0;
+}
+
 /*
  * Pop the error from the Actor onto the given Lua stack.
  */
@@ -72,6 +100,8 @@ actor_create (lua_State *L)
     actor->script_head = NULL;
     actor->script_tail = NULL;
     actor->id = -1;
+    actor->next_token = 1;
+    actor_reset_suspended(actor);
 
     for (i = 1; i <= len; i++) {
         lua_rawgeti(L, definition_index, i);
@@ -101,6 +131,49 @@ exit:
     return actor;
 }
 
+/*
+ * Tell the Director which messages the Actor may coalesce, by the `coalesce'
+ * field of each loaded Script's object, which is usually set on the Script
+ * itself: true for every message, or a list of message names.
+ *
+ * Test = Script("Test")
+ * Test.coalesce = {"update", "draw"}
+ */
+static void
+actor_declare_coalesce (Actor *actor)
+{
+    lua_State *A = actor->L;
+    Script *script = NULL;
+    int i, len;
+
+    director_coalesce_clear(actor->id);
+
+    for (script = actor->script_head; script != NULL; script = script->next) {
+        if (!script->is_loaded)
+            continue;
+
+        lua_rawgeti(A, LUA_REGISTRYINDEX, script->object_ref);
+        lua_getfield(A, -1, "coalesce");
+
+        if (lua_type(A, -1) == LUA_TTABLE) {
+            len = lua_rawlen(A, -1);
+
+            for (i = 1; i <= len; i++) {
+                lua_rawgeti(A, -1, i);
+
+                if (lua_type(A, -1) == LUA_TSTRING)
+                    director_coalesce(actor->id, lua_tostring(A, -1));
+
+                lua_pop(A, 1);
+            }
+        } else if (lua_toboolean(A, -1)) {
+            director_coalesce(actor->id, NULL);
+        }
+
+        lua_pop(A, 2); /* coalesce and the object */
+    }
+}
+
 /*
  * The Actor loads (or reloads) all of its Scripts marked to be loaded. 
  *
@@ -146,12 +219,427 @@ actor_load (Actor *actor, lua_State *L)
                 goto exit;
     }
 
+    actor_declare_coalesce(actor);
     ret = 0;
 exit:
     assert(lua_gettop(A) == ret);
     return ret;
 }
 
+/*
+ * Returns the Script at the index (starting from 1), NULL if there isn't one.
+ */
+static Script *
+actor_script (Actor *actor, int index)
+{
+    Script *script = actor->script_head;
+
+    while (script != NULL && --index > 0)
+        script = script->next;
+
+    return script;
+}
+
+/*
+ * Handlers which ask another Actor yield this first, followed by the Actor,
+ * the message and the timeout. See `lua_actor_ask'.
+ */
+void *
+actor_ask_marker ()
+{
+    static char marker;
+    return &marker;
+}
+
+/*
+ * Send the Action on top of L to the Director, after `delay' milliseconds or
+ * as soon as possible if it is 0, with the thread requirement. Pops the
+ * Action.
+ *
+ * Returns 0 if successful, 1 if the Director refused the Action, which leaves
+ * an error string on top of the Actor's stack.
+ */
+static int
+actor_dispatch (Actor *actor, lua_State *L, const int delay, const int thread)
+{
+    const int action_index = lua_gettop(L);
+    int args = 1;
+    int ret;
+
+    if (delay > 0) {
+        lua_pushcfunction(L, director_take_delayed_action);
+        lua_pushinteger(L, delay);
+        args++;
+    } else {
+        lua_pushcfunction(L, director_take_action);
+    }
+
+    lua_pushvalue(L, action_index);
+
+    if (thread > NODE_INVALID) {
+        lua_pushinteger(L, thread);
+        args++;
+    }
+
+    ret = lua_pcall(L, args, 0, 0) != 0;
+
+    if (ret) {
+        utils_copy_top(actor->L, L);
+        lua_pop(L, 1);
+    }
+
+    lua_remove(L, action_index);
+    return ret;
+}
+
+/*
+ * Send the question the handler in C yielded to another Actor, with a reply
+ * that resumes the handler with the token. The handle of the question's
+ * timeout, -1 if it has none, is put in `timeout'.
+ *
+ * Returns 0 if successful, 1 if the question couldn't be sent, which leaves
+ * an error string on top of the Actor's stack.
+ */
+static int
+actor_ask (Actor *actor, lua_State *L, lua_State *C, const int token,
+        int *timeout)
+{
+    const int thread = tree_node_thread(actor->id);
+    int i;
+
+    lua_pushcfunction(L, company_ask);
+
+    /* the Actor and the message */
+    for (i = 2; i <= 3; i++) {
+        lua_pushvalue(C, i);
+        utils_copy_top(L, C);
+        lua_pop(C, 1);
+    }
+
+    /* {{actor, "resume", token}, thread} */
+    lua_createtable(L, 2, 0);
+    lua_createtable(L, 3, 0);
+    lua_pushinteger(L, actor->id);
+    lua_rawseti(L, -2, 1);
+    lua_pushliteral(L, "resume");
+    lua_rawseti(L, -2, 2);
+    lua_pushinteger(L, token);
+    lua_rawseti(L, -2, 3);
+    lua_rawseti(L, -2, 1);
+
+    if (thread > NODE_INVALID) {
+        lua_pushinteger(L, thread);
+        lua_rawseti(L, -2, 2);
+    }
+
+    lua_pushinteger(L, lua_tointeger(C, 4));
+
+    if (lua_pcall(L, 4, 1, 0) != 0) {
+        utils_copy_top(actor->L, L);
+        lua_pop(L, 1);
+        return 1;
+    }
+
+    *timeout = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    return 0;
+}
+
+/*
+ * Answer the question a message came with, if it came with one. Expects the
+ * reply ({action [, thread]} or nil) at base of the Actor's stack and the
+ * results (a finished coroutine or nil) above it. The reply Action is sent
+ * with `true' and the results or, if not `is_ok', `false' and the error on
+ * top of the Actor's stack.
+ *
+ * Returns 0 if successful, 1 if the reply couldn't be sent, which pushes an
+ * error string onto the Actor's stack.
+ */
+static int
+actor_reply (Actor *actor, lua_State *L, const int base, const int is_ok)
+{
+    lua_State *A = actor->L;
+    lua_State *C = NULL;
+    int i, n, count, thread = NODE_INVALID;
+
+    if (lua_isnil(A, base))
+        return 0;
+
+    lua_rawgeti(A, base, 2);
+
+    if (lua_isnumber(A, -1))
+        thread = lua_tointeger(A, -1);
+
+    lua_pop(A, 1);
+
+    lua_rawgeti(A, base, 1);
+    utils_copy_top(L, A);
+    lua_pop(A, 1);
+    n = luaL_len(L, -1);
+
+    lua_pushboolean(L, is_ok);
+    lua_rawseti(L, -2, ++n);
+
+    if (!is_ok) {
+        utils_copy_top(L, A);
+        lua_rawseti(L, -2, ++n);
+    } else if (lua_type(A, base + 1) == LUA_TTHREAD) {
+        C = lua_tothread(A, base + 1);
+        count = lua_gettop(C);
+
+        for (i = 1; i <= count; i++) {
+            lua_pushvalue(C, i);
+            utils_copy_top(L, C);
+            lua_pop(C, 1);
+            lua_rawseti(L, -2, ++n);
+        }
+    }
+
+    return actor_dispatch(actor, L, 0, thread);
+}
+
+/*
+ * A message failed with the error on top of the Actor's stack, above its
+ * reply and results at base. Answer with the error and leave only the error.
+ * Always returns 1.
+ */
+static int
+actor_fail (Actor *actor, lua_State *L, const int base)
+{
+    lua_State *A = actor->L;
+
+    /* the message's own error matters more than one from replying */
+    if (actor_reply(actor, L, base, 0) != 0)
+        lua_pop(A, 1);
+
+    lua_replace(A, base);
+    lua_settop(A, base);
+    return 1;
+}
+
+/*
+ * Suspend the handler of the Script at index, which yielded. Expects the
+ * reply, results, message and then the handler's coroutine on top of the
+ * Actor's stack and pops all of them. The handler either asked another Actor
+ * a question (see `actor_ask') or yielded an optional delay and an optional
+ * flag to let other messages interleave with it.
+ *
+ * Returns SCRIPT_YIELDED if successful, 1 if the resume couldn't be
+ * scheduled, which leaves the reply, results and an error string instead.
+ */
+static int
+actor_suspend (Actor *actor, lua_State *L, const int index)
+{
+    lua_State *A = actor->L;
+    lua_State *C = lua_tothread(A, -1);
+    const int base = lua_gettop(A) - 3;
+    const int token = actor->next_token++;
+    int is_exclusive = 1;
+    int timeout = -1;
+    int ret;
+
+    /* we hold the Actor, so it can't be resumed before it is suspended */
+    if (lua_touserdata(C, 1) == actor_ask_marker()) {
+        ret = actor_ask(actor, L, C, token, &timeout);
+    } else {
+        is_exclusive = !lua_toboolean(C, 2);
+
+        /* {actor, "resume", token} */
+        lua_createtable(L, 3, 0);
+        lua_pushinteger(L, actor->id);
+        lua_rawseti(L, -2, 1);
+        lua_pushliteral(L, "resume");
+        lua_rawseti(L, -2, 2);
+        lua_pushinteger(L, token);
+        lua_rawseti(L, -2, 3);
+
+        ret = actor_dispatch(actor, L, 
+                lua_type(C, 1) == LUA_TNUMBER ? lua_tointeger(C, 1) : 0,
+                tree_node_thread(actor->id));
+    }
+
+    lua_settop(C, 0);
+
+    if (ret != 0) {
+        lua_replace(A, base + 2); /* message */
+        lua_settop(A, base + 2);
+        return 1;
+    }
+
+    /* suspended[token] = {coroutine, message, index, is_exclusive, reply,
+     * results, timeout} */
+    lua_rawgeti(A, LUA_REGISTRYINDEX, actor->suspended_ref);
+    lua_createtable(A, 7, 0);
+    lua_pushvalue(A, base + 3);
+    lua_rawseti(A, -2, 1);
+    lua_pushvalue(A, base + 2);
+    lua_rawseti(A, -2, 2);
+    lua_pushinteger(A, index);
+    lua_rawseti(A, -2, 3);
+    lua_pushboolean(A, is_exclusive);
+    lua_rawseti(A, -2, 4);
+    lua_pushvalue(A, base);
+    lua_rawseti(A, -2, 5);
+    lua_pushvalue(A, base + 1);
+    lua_rawseti(A, -2, 6);
+    lua_pushinteger(A, timeout);
+    lua_rawseti(A, -2, 7);
+    lua_rawseti(A, -2, token);
+    lua_settop(A, base - 1);
+
+    actor->exclusive += is_exclusive;
+    return SCRIPT_YIELDED;
+}
+
+/*
+ * Send the message to the Actor's loaded Scripts, starting with the given
+ * Script at index. Expects the message's reply, its results so far and then
+ * the message on top of the Actor's stack and pops them. The results of the
+ * last Script which returned anything are what the reply is sent with.
+ *
+ * Returns 0 if every Script handled it, SCRIPT_YIELDED if a Script's handler
+ * was suspended (the Scripts after it get the message once it's resumed), or
+ * 1 if there was an error, which is left on top of the Actor's stack.
+ */
+static int
+actor_deliver (Actor *actor, lua_State *L, Script *script, int index)
+{
+    lua_State *A = actor->L;
+    const int base = lua_gettop(A) - 2;
+    int ret = 0;
+
+    for (; script != NULL; script = script->next, index++) {
+        if (!script->is_loaded)
+            continue;
+
+        ret = script_send(script, A);
+
+        if (ret == SCRIPT_YIELDED) {
+            if (actor_suspend(actor, L, index) != 0)
+                return actor_fail(actor, L, base);
+
+            return SCRIPT_YIELDED;
+        }
+
+        if (ret != 0) {
+            lua_remove(A, base + 2); /* message */
+            return actor_fail(actor, L, base);
+        }
+
+        /* keep the finished coroutine if it returned anything */
+        if (lua_gettop(lua_tothread(A, -1)) > 0)
+            lua_replace(A, base + 1);
+        else
+            lua_pop(A, 1);
+    }
+
+    lua_pop(A, 1); /* message */
+
+    if (actor_reply(actor, L, base, 1) != 0) {
+        lua_replace(A, base);
+        lua_settop(A, base);
+        return 1;
+    }
+
+    lua_settop(A, base - 1);
+    return 0;
+}
+
+/*
+ * Deliver the messages which arrived while an exclusive handler was
+ * suspended, in the order they arrived, until the queue is empty or another
+ * exclusive handler is suspended. The deferred table keeps each message at
+ * its position and its reply at the negative of it.
+ *
+ * Returns 0 if successful, 1 if there was an error, which is left on top of
+ * the Actor's stack.
+ */
+static int
+actor_drain (Actor *actor, lua_State *L)
+{
+    lua_State *A = actor->L;
+    int position;
+
+    while (actor->exclusive == 0 
+            && actor->deferred_first <= actor->deferred_last) {
+        position = actor->deferred_first++;
+
+        lua_rawgeti(A, LUA_REGISTRYINDEX, actor->deferred_ref);
+        lua_rawgeti(A, -1, -position);
+        lua_pushnil(A); /* results */
+        lua_rawgeti(A, -3, position);
+
+        lua_pushnil(A);
+        lua_rawseti(A, -5, position);
+        lua_pushnil(A);
+        lua_rawseti(A, -5, -position);
+        lua_remove(A, -4); /* deferred table */
+
+        if (actor_deliver(actor, L, actor->script_head, 1) == 1)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Accept the message on top of L, with the reply at reply_index of L if it
+ * is a question (0 if it isn't), and deliver it or defer it. See
+ * `actor_send'.
+ */
+static int
+actor_accept (Actor *actor, lua_State *L, const int reply_index)
+{
+    lua_State *A = actor->L;
+    Script *script = NULL;
+    int count = 0;
+    int ret = 1;
+
+    luaL_checktype(L, -1, LUA_TTABLE);
+
+    if (reply_index) {
+        lua_pushvalue(L, reply_index);
+        utils_copy_top(A, L);
+        lua_pop(L, 1);
+    } else {
+        lua_pushnil(A);
+    }
+
+    lua_pushnil(A); /* results */
+
+    for (script = actor->script_head; script != NULL; script = script->next)
+        count += script->is_loaded;
+
+    if (count == 0) {
+        lua_pushfstring(A, "Actor `%d' has no loaded Scripts!", actor->id);
+        actor_fail(actor, L, 1);
+        goto exit;
+    }
+
+    utils_copy_top(A, L);
+
+    /* an exclusive handler is suspended, the message waits its turn */
+    if (actor->exclusive > 0) {
+        actor->deferred_last++;
+        lua_rawgeti(A, LUA_REGISTRYINDEX, actor->deferred_ref);
+        lua_insert(A, 1);
+        lua_rawseti(A, 1, actor->deferred_last);
+        lua_pop(A, 1); /* results */
+        lua_rawseti(A, 1, -actor->deferred_last);
+        lua_pop(A, 1); /* deferred table */
+        ret = 0;
+        goto exit;
+    }
+
+    if (actor_deliver(actor, L, actor->script_head, 1) == 1)
+        goto exit;
+
+    ret = actor_drain(actor, L);
+exit:
+    assert(lua_gettop(A) == ret);
+    return ret;
+}
+
 /*
  * The Actor sends the message to all of its Scripts which are loaded.
  *
@@ -161,6 +649,12 @@ exit:
  * The function copies the table from the given Lua stack (L) onto the Actor's
  * Lua stack for all Scripts to access.
  *
+ * Each handler runs in a coroutine and may yield, e.g. through 
+ * `actor:sleep(ms)'. The Worker then moves on and the handler is resumed
+ * later (see `actor_resume'). Until it is done, messages for the Actor are
+ * kept in order and delivered afterwards, unless the handler opted in to
+ * interleaving when it yielded.
+ *
  * Errors from Scripts are caught in sequential order. Meaning an error for the
  * first Script will mask errors for any remaining. Errors are left on top of
  * the Actor's stack and 1 is returned. Otherwise, success, and returns 0.
@@ -171,33 +665,149 @@ exit:
 int
 actor_send (Actor *actor, lua_State *L)
 {
+    return actor_accept(actor, L, 0);
+}
+
+/*
+ * Like `actor_send' but the message is a question from `ask'. Expects the
+ * Actor, the reply ({action [, thread]}) and the message on L. Once the
+ * handlers are done, the reply Action is sent with `true' and what they
+ * returned appended to it, or `false' and the error.
+ */
+int
+actor_answer (Actor *actor, lua_State *L)
+{
+    const int reply_arg = 2;
+
+    luaL_checktype(L, reply_arg, LUA_TTABLE);
+    return actor_accept(actor, L, reply_arg);
+}
+
+/*
+ * Resume a suspended handler. Expects the Actor, the handler's token and then
+ * any values for the handler (the results of its yield) on L. Tokens are
+ * never reused, so resuming a handler which is gone (e.g. the Actor was
+ * unloaded or its question already timed out) does nothing.
+ *
+ * Returns 0 if successful, 1 if there was an error, which is left on top of
+ * the Actor's stack.
+ */
+int
+actor_resume (Actor *actor, lua_State *L)
+{
+    const int token_arg = 2;
+    const int token = luaL_checkinteger(L, token_arg);
+    const int args = lua_gettop(L) - token_arg;
     lua_State *A = actor->L;
+    lua_State *C = NULL;
     Script *script = NULL;
-    int count = 0;
-    int ret = 1;
+    int i, index, ret = 0;
 
-    luaL_checktype(L, -1, LUA_TTABLE);
-    utils_copy_top(A, L);
+    lua_rawgeti(A, LUA_REGISTRYINDEX, actor->suspended_ref);
+    lua_rawgeti(A, -1, token);
 
-    for (script = actor->script_head; script != NULL; script = script->next) {
-        if (script->is_loaded) {
-            count++;
-            if (script_send(script, A) != 0)
-                goto insert_error;
-        }
+    if (lua_isnil(A, -1)) {
+        lua_pop(A, 2);
+        goto exit;
     }
 
-    if (count == 0) {
-        lua_pushfstring(A, "Actor `%d' has no loaded Scripts!", actor->id);
-insert_error:
-        /* push error string to bottom so message table is popped */
-        lua_insert(A, 1);
-        goto exit;
+    lua_pushnil(A);
+    lua_rawseti(A, -3, token);
+
+    /* the first answer to a question wins, its timeout is of no more use */
+    lua_rawgeti(A, -1, 7);
+    director_cancel(lua_tointeger(A, -1));
+    lua_pop(A, 1);
+
+    lua_rawgeti(A, -1, 3);
+    index = lua_tointeger(A, -1);
+    lua_rawgeti(A, -2, 4);
+    actor->exclusive -= lua_toboolean(A, -1);
+    lua_pop(A, 2);
+
+    /* leave the reply, results, message and coroutine */
+    for (i = 5; i <= 6; i++)
+        lua_rawgeti(A, 2, i);
+
+    lua_rawgeti(A, 2, 2);
+    lua_rawgeti(A, 2, 1);
+    lua_remove(A, 1); /* suspended table */
+    lua_remove(A, 1); /* state */
+
+    C = lua_tothread(A, -1);
+    script = actor_script(actor, index);
+
+    /* the Script was unloaded while the handler was suspended */
+    if (!script || !script->is_loaded) {
+        lua_pop(A, 1);
+        ret = actor_deliver(actor, L, script ? script->next : NULL, index + 1);
+        goto done;
     }
 
-    ret = 0;
+    for (i = 1; i <= args; i++) {
+        lua_pushvalue(L, token_arg + i);
+        utils_copy_top(C, L);
+        lua_pop(L, 1);
+    }
+
+    switch (script_resume(script, A, args)) {
+    case 0:
+        if (lua_gettop(C) > 0)
+            lua_replace(A, 2);
+        else
+            lua_pop(A, 1);
+
+        ret = actor_deliver(actor, L, script->next, index + 1);
+        break;
+
+    case SCRIPT_YIELDED:
+        ret = actor_suspend(actor, L, index);
+
+        if (ret != 0)
+            ret = actor_fail(actor, L, 1);
+        break;
+
+    default:
+        lua_remove(A, 3); /* message */
+        ret = actor_fail(actor, L, 1);
+        break;
+    }
+
+done:
+    if (ret == 1)
+        goto exit;
+
+    ret = actor_drain(actor, L);
 exit:
-    lua_pop(A, 1); /* message table */
+    assert(lua_gettop(A) == ret);
+    return ret;
+}
+
+/*
+ * Call the callback with the id inside the Actor's state. Expects the Actor,
+ * the id and then the callback's arguments on L. This is how the answer to an
+ * `ask' with a callback gets back to the Actor which asked. Callbacks can't
+ * yield.
+ *
+ * Returns 0 if successful, 1 if there was an error, which is left on top of
+ * the Actor's stack.
+ */
+int
+actor_callback (Actor *actor, lua_State *L)
+{
+    const int id_arg = 2;
+    const int id = luaL_checkinteger(L, id_arg);
+    const int args = lua_gettop(L) - id_arg;
+    lua_State *A = actor->L;
+    int i, ret;
+
+    for (i = 1; i <= args; i++) {
+        lua_pushvalue(L, id_arg + i);
+        utils_copy_top(A, L);
+        lua_pop(L, 1);
+    }
+
+    ret = company_do_callback(A, id, args);
     assert(lua_gettop(A) == ret);
     return ret;
 }
@@ -261,6 +871,10 @@ actor_unload (Actor *actor, lua_State *L)
     for (script = actor->script_head; script != NULL; script = script->next)
         script_unload(script, A);
 
+    luaL_unref(A, LUA_REGISTRYINDEX, actor->suspended_ref);
+    luaL_unref(A, LUA_REGISTRYINDEX, actor->deferred_ref);
+    actor_reset_suspended(actor);
+
     assert(lua_gettop(A) == 0);
     return 0;
 }
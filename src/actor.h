@@ -34,6 +34,9 @@ actor_pop_error (Actor *actor, lua_State *L);
  * If one passes the string "all" then all Scripts will be loaded. If one
  * passes an integer, that is the nth Script which will be loaded.
  *
+ * Once loaded, the `coalesce' field of each Script (true, or a list of
+ * message names) tells the Director which messages' stale copies it skips.
+ *
  * Errors from Scripts are caught in sequential order. Meaning an error for the
  * first Script will mask errors for any remaining. Errors are left on top of
  * the Actor's stack and 1 is returned. Otherwise, success, and returns 0.
@@ -60,6 +63,12 @@ actor_probe (Actor *actor, lua_State *L);
  * The function copies the table from the given Lua stack (L) onto the Actor's
  * Lua stack for all Scripts to access.
  *
+ * Each handler runs in a coroutine and may yield, e.g. through 
+ * `actor:sleep(ms)'. The Worker then moves on and the handler is resumed
+ * later (see `actor_resume'). Until it is done, messages for the Actor are
+ * kept in order and delivered afterwards, unless the handler opted in to
+ * interleaving when it yielded.
+ *
  * Errors from Scripts are caught in sequential order. Meaning an error for the
  * first Script will mask errors for any remaining. Errors are left on top of
  * the Actor's stack and 1 is returned. Otherwise, success, and returns 0.
@@ -70,6 +79,46 @@ actor_probe (Actor *actor, lua_State *L);
 int
 actor_send (Actor *actor, lua_State *L);
 
+/*
+ * Resume a suspended handler. Expects the Actor, the handler's token and then
+ * any values for the handler (the results of its yield) on L. Tokens are
+ * never reused, so resuming a handler which is gone (e.g. the Actor was
+ * unloaded or its question already timed out) does nothing.
+ *
+ * Returns 0 if successful, 1 if there was an error, which is left on top of
+ * the Actor's stack.
+ */
+int
+actor_resume (Actor *actor, lua_State *L);
+
+/*
+ * Like `actor_send' but the message is a question from `ask'. Expects the
+ * Actor, the reply ({action [, thread]}) and the message on L. Once the
+ * handlers are done, the reply Action is sent with `true' and what they
+ * returned appended to it, or `false' and the error.
+ */
+int
+actor_answer (Actor *actor, lua_State *L);
+
+/*
+ * Call the callback with the id inside the Actor's state. Expects the Actor,
+ * the id and then the callback's arguments on L. This is how the answer to an
+ * `ask' with a callback gets back to the Actor which asked. Callbacks can't
+ * yield.
+ *
+ * Returns 0 if successful, 1 if there was an error, which is left on top of
+ * the Actor's stack.
+ */
+int
+actor_callback (Actor *actor, lua_State *L);
+
+/*
+ * Handlers which ask another Actor yield this first, followed by the Actor,
+ * the message and the timeout. See `lua_actor_ask'.
+ */
+void *
+actor_ask_marker ();
+
 /*
  * Unload all the scripts of an actor. This is effectively the 'destructor' of
  * Dialogue's actors. `actor_destroy` actually frees the memory of the actor
@@ -8,6 +8,7 @@
 
 #define COMPANY_META "Dialogue.Company"
 #define ACTOR_META "Dialogue.Company.Actor"
+#define COMPANY_CALLBACKS "Dialogue.Company.Callbacks"
 
 /*
  * Create the Company tree with the number of actors.
@@ -401,11 +402,12 @@ company_call_actor_func (lua_State *L, int id, ActorFunc func)
 }
 
 /*
- * Actor( definition_table [, parent] [, thread] )
+ * Actor( definition_table [, parent] [, thread | pool] )
  *
  * Creates the actor from the given definition table (see actor.h for more
  * info). An optional Actor object that should be the parent of the created 
- * Actor can be passed.
+ * Actor can be passed, or nil for none. Giving the name of a Worker pool
+ * instead of a thread places the Actor into that pool (see `Director.pool').
  */
 int
 lua_actor_new (lua_State *L)
@@ -416,25 +418,39 @@ lua_actor_new (lua_State *L)
     int args = lua_gettop(L);
     int parent = NODE_INVALID;
     int thread = NODE_INVALID;
+    int pool = 0;
+    int id;
     
     luaL_checktype(L, definition_arg, LUA_TTABLE);
 
-    /* get the thread id, then pop it and any extra args */
+    /* get the thread id or pool, then pop it and any extra args */
     if (args >= thread_arg) {
-        thread = luaL_checkinteger(L, thread_arg);
+        if (lua_type(L, thread_arg) == LUA_TSTRING) {
+            pool = director_pool_id(lua_tostring(L, thread_arg));
+
+            if (pool == -1)
+                luaL_error(L, "Failed to create actor: no pool `%s`!", 
+                        lua_tostring(L, thread_arg));
+        } else {
+            thread = luaL_checkinteger(L, thread_arg);
+        }
+
         lua_pop(L, args - thread_arg + 1);
         args = parent_arg;
     }
 
     /* get the parent id, then pop it and extra args, leaving table on top */
     if (args >= parent_arg) {
-        parent = company_actor_id(L, parent_arg);
+        if (!lua_isnil(L, parent_arg))
+            parent = company_actor_id(L, parent_arg);
         lua_pop(L, args - parent_arg + 1);
     }
 
     assert(lua_gettop(L) == definition_arg);
 
-    company_push_actor(L, company_add(L, parent, thread));
+    id = company_add(L, parent, thread);
+    director_place_actor(id, pool);
+    company_push_actor(L, id);
 
     if (dialogue_actor_manual_load())
         goto exit;
@@ -522,8 +538,9 @@ lua_actor_unload (lua_State *L)
 }
 
 /*
- * Create a child actor with this object as the parent.
- * actor:child({ definition_table } [, thread])
+ * Create a child actor with this object as the parent, optionally placed
+ * into a Worker pool by its name.
+ * actor:child({ definition_table } [, thread | pool])
  */
 int
 lua_actor_child (lua_State *L)
@@ -531,7 +548,9 @@ lua_actor_child (lua_State *L)
     const int self_arg = 1;
     const int table_arg = 2;
     const int thread_opt_arg = 3;
-    const int thread = luaL_optinteger(L, thread_opt_arg, NODE_INVALID);
+    const int is_pool = lua_type(L, thread_opt_arg) == LUA_TSTRING;
+    const int thread = is_pool ? NODE_INVALID 
+        : luaL_optinteger(L, thread_opt_arg, NODE_INVALID);
     int args = 3;
 
     lua_pushcfunction(L, lua_actor_new);
@@ -539,7 +558,10 @@ lua_actor_child (lua_State *L)
     lua_pushvalue(L, table_arg);
     lua_pushvalue(L, self_arg); /* parent */
 
-    if (thread != NODE_INVALID) {
+    if (is_pool) {
+        lua_pushvalue(L, thread_opt_arg);
+        args++;
+    } else if (thread != NODE_INVALID) {
         lua_pushinteger(L, thread);
         args++;
     }
@@ -736,34 +758,132 @@ lua_actor_probe (lua_State *L)
 }
 
 /*
- * Create an Action for the Director for the actor. "Task" it with doing the
- * method (with the given arguments).
- *
- * actor:async("send", "draw", 50, 50) => {actor, "send", "draw", 50, 50}
- * actor:async("load") => {actor, "load"}
+ * Returns the thread requirement of the Actor at self_arg, NODE_INVALID if it
+ * has none. Errors through L if there is no such Actor.
  */
-int
-lua_actor_async (lua_State *L)
+static int
+company_async_thread (lua_State *L, const int self_arg, const int method_arg)
 {
-    const int self_arg = 1;
-    const int args = lua_gettop(L);
     const int id = company_actor_id(L, self_arg);
     const int thread_id = tree_node_thread(id);
-    int i, call_args = 1;
 
     if (thread_id == NODE_ERROR)
         luaL_error(L, 
                 "Starting async method `%s` failed: invalid Actor id `%d`!", 
-                lua_tostring(L, self_arg + 1), id);
+                lua_tostring(L, method_arg), id);
 
-    lua_pushcfunction(L, director_take_action);
+    return thread_id;
+}
+
+/*
+ * Returns the code of the method at index (see `action_method'), ACTION_CALL
+ * if it has none.
+ */
+static inline int
+company_async_method (lua_State *L, const int index)
+{
+    if (lua_type(L, index) != LUA_TSTRING)
+        return ACTION_CALL;
+
+    return action_method(lua_tostring(L, index));
+}
+
+/*
+ * Push the Director's function, then a new Action table for the Actor at
+ * self_arg with the method and arguments from method_arg onwards. Returns the
+ * Actor's thread requirement, NODE_INVALID if it has none.
+ */
+static int
+company_push_async (lua_State *L, lua_CFunction take, const int self_arg,
+        const int method_arg)
+{
+    const int args = lua_gettop(L);
+    const int thread_id = company_async_thread(L, self_arg, method_arg);
+    int i;
+
+    lua_pushcfunction(L, take);
     lua_newtable(L);
 
-    for (i = self_arg; i <= args; i++) {
+    lua_pushvalue(L, self_arg);
+    lua_rawseti(L, -2, 1);
+
+    for (i = method_arg; i <= args; i++) {
         lua_pushvalue(L, i);
-        lua_rawseti(L, -2, i);
+        lua_rawseti(L, -2, i - method_arg + 2);
     }
 
+    return thread_id;
+}
+
+/*
+ * Create an Action for the Director for the actor. "Task" it with doing the
+ * method (with the given arguments). Methods with a code, like `send', skip
+ * the table (see `director_take_call').
+ *
+ * actor:async("send", "draw", 50, 50) => {actor, "send", "draw", 50, 50}
+ * actor:async("load") => {actor, "load"}
+ */
+int
+lua_actor_async (lua_State *L)
+{
+    const int self_arg = 1;
+    const int method_arg = 2;
+    const int method = company_async_method(L, method_arg);
+    int call_args = 1;
+    int thread_id;
+
+    if (method != ACTION_CALL) {
+        thread_id = company_async_thread(L, self_arg, method_arg);
+        lua_remove(L, method_arg);
+        director_take_call(L, method, self_arg, lua_gettop(L), -1, thread_id);
+        return 0;
+    }
+
+    thread_id = company_push_async(L, director_take_action, self_arg, 
+            method_arg);
+
+    if (thread_id > NODE_INVALID) {
+        lua_pushinteger(L, thread_id);
+        call_args++;
+    }
+
+    lua_call(L, call_args, 0);
+
+    return 0;
+}
+
+/*
+ * Like `async' but with a priority, "high" or "normal". High priority Actions
+ * are handled before any normal Actions queued for the Worker.
+ *
+ * actor:async_priority("high", "send", {"pause"}) => {actor, "send", {"pause"}}
+ */
+int
+lua_actor_async_priority (lua_State *L)
+{
+    static const char *priorities[] = { "normal", "high", NULL };
+    const int self_arg = 1;
+    const int priority_arg = 2;
+    const int method_arg = 3;
+    const int method = company_async_method(L, method_arg);
+    int call_args = 2;
+    int thread_id, priority;
+
+    if (method != ACTION_CALL) {
+        priority = luaL_checkoption(L, priority_arg, NULL, priorities);
+        thread_id = company_async_thread(L, self_arg, method_arg);
+        lua_remove(L, method_arg);
+        lua_remove(L, priority_arg);
+        director_take_call(L, method, self_arg, lua_gettop(L), 
+                priority == 1 ? ACTION_HIGH : ACTION_NORMAL, thread_id);
+        return 0;
+    }
+
+    thread_id = company_push_async(L, director_take_priority_action, 
+            self_arg, method_arg);
+
+    lua_pushvalue(L, priority_arg);
+
     if (thread_id > NODE_INVALID) {
         lua_pushinteger(L, thread_id);
         call_args++;
@@ -799,7 +919,7 @@ company_actor_tone (lua_State *L, const char *tone)
     const int message_arg = 2;
     const int audience_index = 3;
     const int id = company_actor_id(L, actor_arg);
-    int i;
+    int i, recipient, thread_id;
 
     /* append the actor's id to the message (set the author) */
     lua_pushinteger(L, id);
@@ -807,13 +927,23 @@ company_actor_tone (lua_State *L, const char *tone)
 
     company_push_audience(L, id, tone);
 
-    /* foreach (actor : audience) { actor:async("send", {msg}) } */
+    /* 
+     * foreach (actor : audience) { actor:async("send", {msg}) }, except no
+     * Action table is built, the recipient and message are sent as they are
+     */
     for (i = 1; i <= luaL_len(L, audience_index); i++) {
-        lua_pushcfunction(L, lua_actor_async);
         lua_rawgeti(L, audience_index, i);
-        lua_pushliteral(L, "send");
+        recipient = lua_tointeger(L, -1);
+        thread_id = tree_node_thread(recipient);
+
+        if (thread_id == NODE_ERROR)
+            luaL_error(L, 
+                "Starting async method `send` failed: invalid Actor id `%d`!", 
+                recipient);
+
         lua_pushvalue(L, message_arg);
-        lua_call(L, 3, 0);
+        director_take_call(L, ACTION_SEND, -2, 2, -1, thread_id);
+        lua_pop(L, 2);
     }
 
     return 0;
@@ -897,6 +1027,413 @@ lua_actor_think (lua_State *L)
     return 0;
 }
 
+/*
+ * Send a message to itself after a delay in milliseconds. Returns the handle
+ * which `Director.cancel' takes.
+ * actor:after(500, {"respawn"})
+ */
+int
+lua_actor_after (lua_State *L)
+{
+    const int actor_arg = 1;
+    const int delay_arg = 2;
+    const int message_arg = 3;
+    const int author_id = company_actor_id(L, actor_arg);
+    const int thread_id = tree_node_thread(author_id);
+    int call_args = 2;
+
+    luaL_checktype(L, message_arg, LUA_TTABLE);
+
+    /* append the actor's id to the message (set the author) */
+    lua_pushinteger(L, author_id);
+    lua_rawseti(L, message_arg, luaL_len(L, message_arg) + 1);
+
+    lua_pushcfunction(L, director_take_delayed_action);
+    lua_pushvalue(L, delay_arg);
+
+    /* {actor, "send", message} */
+    lua_createtable(L, 3, 0);
+    lua_pushvalue(L, actor_arg);
+    lua_rawseti(L, -2, 1);
+    lua_pushliteral(L, "send");
+    lua_rawseti(L, -2, 2);
+    lua_pushvalue(L, message_arg);
+    lua_rawseti(L, -2, 3);
+
+    if (thread_id > NODE_INVALID) {
+        lua_pushinteger(L, thread_id);
+        call_args++;
+    }
+
+    lua_call(L, call_args, 1);
+    return 1;
+}
+
+/*
+ * Send a message to the Actor which is only worth handling for `ttl'
+ * milliseconds. It is dropped unhandled after that, and the Actor handles
+ * it before any of its queued messages with a later deadline, or none. So
+ * it can overtake what the same sender sent before it: only messages with
+ * the same deadline, or none, keep the order they were sent in.
+ * actor:send_by(16, {"input", "up"}) => {actor, "send", message, ttl = 16}
+ */
+int
+lua_actor_send_by (lua_State *L)
+{
+    const int actor_arg = 1;
+    const int ttl_arg = 2;
+    const int message_arg = 3;
+    const int id = company_actor_id(L, actor_arg);
+    const int thread_id = tree_node_thread(id);
+    int call_args = 1;
+
+    luaL_checknumber(L, ttl_arg);
+    luaL_checktype(L, message_arg, LUA_TTABLE);
+
+    lua_pushcfunction(L, director_take_action);
+
+    lua_createtable(L, 3, 1);
+    lua_pushvalue(L, actor_arg);
+    lua_rawseti(L, -2, 1);
+    lua_pushliteral(L, "send");
+    lua_rawseti(L, -2, 2);
+    lua_pushvalue(L, message_arg);
+    lua_rawseti(L, -2, 3);
+    lua_pushvalue(L, ttl_arg);
+    lua_setfield(L, -2, "ttl");
+
+    if (thread_id > NODE_INVALID) {
+        lua_pushinteger(L, thread_id);
+        call_args++;
+    }
+
+    lua_call(L, call_args, 0);
+    return 0;
+}
+
+/*
+ * Resume the Actor's suspended handler with the token. Any values after the
+ * token are what its yield returns. This is what the Director sends when a
+ * handler's sleep is over.
+ * actor:resume(token [, value1 [, ... [, valueN]]])
+ */
+int
+lua_actor_resume (lua_State *L)
+{
+    const int actor_arg = 1;
+    const int id = company_actor_id(L, actor_arg);
+    company_call_actor_func(L, id, actor_resume);
+    return 0;
+}
+
+/*
+ * Suspend the running handler, letting its Worker handle other Actors, and
+ * resume it after `ms' milliseconds or as soon as possible without them.
+ * Messages for the Actor wait until the handler is done unless `interleave'
+ * is true. This is sugar for `coroutine.yield(ms, interleave)'.
+ * actor:sleep(100)
+ * actor:sleep(100, true)
+ */
+int
+lua_actor_sleep (lua_State *L)
+{
+    lua_remove(L, 1);
+    return lua_yield(L, lua_gettop(L));
+}
+
+/*
+ * Keep the function at index in the state's callback table until it is
+ * called. Returns its id, which is never reused, so a second answer for the
+ * same future finds nothing.
+ */
+static int
+company_add_callback (lua_State *L, const int index)
+{
+    int id;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, COMPANY_CALLBACKS);
+    lua_getfield(L, -1, "n");
+    id = lua_tointeger(L, -1) + 1;
+    lua_pop(L, 1);
+
+    lua_pushinteger(L, id);
+    lua_setfield(L, -2, "n");
+    lua_pushvalue(L, index);
+    lua_rawseti(L, -2, id);
+    lua_pop(L, 1);
+
+    return id;
+}
+
+/*
+ * Keep the handle of the timeout of the callback with the id, which is
+ * cancelled once the callback is called. It is kept at -id in the state's
+ * callback table.
+ */
+static void
+company_set_timeout (lua_State *L, const int id, const int handle)
+{
+    if (handle < 0)
+        return;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, COMPANY_CALLBACKS);
+    lua_pushinteger(L, handle);
+    lua_rawseti(L, -2, -id);
+    lua_pop(L, 1);
+}
+
+/*
+ * Call and forget the callback with the id, given the `args' values on top of
+ * L, which are popped. A callback which was already called is ignored. The
+ * callback's timeout is cancelled, whichever answer came first.
+ *
+ * Returns 0 if successful, 1 if the callback errored, which leaves the error
+ * on top of L.
+ */
+int
+company_do_callback (lua_State *L, const int id, const int args)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, COMPANY_CALLBACKS);
+    lua_rawgeti(L, -1, -id);
+
+    if (lua_isnumber(L, -1)) {
+        director_cancel(lua_tointeger(L, -1));
+        lua_pushnil(L);
+        lua_rawseti(L, -3, -id);
+    }
+
+    lua_pop(L, 1);
+    lua_rawgeti(L, -1, id);
+    lua_pushnil(L);
+    lua_rawseti(L, -3, id);
+    lua_remove(L, -2); /* callback table */
+
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, args + 1);
+        return 0;
+    }
+
+    lua_insert(L, -(args + 1));
+    return lua_pcall(L, args, 0, 0) != 0;
+}
+
+/*
+ * Send the message to the Actor as a question. It is answered by sending the
+ * reply Action with `true' and what the handler returned appended to it, or
+ * `false' and an error. If the timeout is positive, the reply is sent with
+ * `false, "timeout"' after that many milliseconds. Whichever comes first
+ * wins, the other is ignored.
+ *
+ * Returns the handle of the timeout's Action (see `Director.after'), or -1
+ * if there is none. Whoever gets the answer first cancels it, so it doesn't
+ * sit in the Timer (and keep the Director busy) for the whole timeout.
+ *
+ * company_ask(actor, message, {reply_action [, reply_thread]} [, timeout])
+ */
+int
+company_ask (lua_State *L)
+{
+    const int actor_arg = 1;
+    const int message_arg = 2;
+    const int reply_arg = 3;
+    const int timeout_arg = 4;
+    const int id = company_actor_id(L, actor_arg);
+    const int thread = tree_node_thread(id);
+    const int timeout = luaL_optint(L, timeout_arg, 0);
+    int args;
+
+    luaL_checktype(L, message_arg, LUA_TTABLE);
+    luaL_checktype(L, reply_arg, LUA_TTABLE);
+
+    /* {actor, "answer", reply, message} without the table */
+    lua_pushinteger(L, id);
+    lua_pushvalue(L, reply_arg);
+    lua_pushvalue(L, message_arg);
+    director_take_call(L, ACTION_ANSWER, -3, 3, -1, thread);
+    lua_pop(L, 3);
+
+    if (timeout <= 0) {
+        lua_pushinteger(L, -1);
+        return 1;
+    }
+
+    /* the question was copied when it was sent, so the reply can change */
+    lua_pushcfunction(L, director_take_delayed_action);
+    lua_pushinteger(L, timeout);
+    lua_rawgeti(L, reply_arg, 1);
+    args = luaL_len(L, -1);
+    lua_pushboolean(L, 0);
+    lua_rawseti(L, -2, ++args);
+    lua_pushliteral(L, "timeout");
+    lua_rawseti(L, -2, ++args);
+    args = 2;
+
+    lua_rawgeti(L, reply_arg, 2);
+
+    if (lua_isnil(L, -1))
+        lua_pop(L, 1);
+    else
+        args++;
+
+    lua_call(L, args, 1);
+    return 1;
+}
+
+/*
+ * Ask the Actor a question: send it the message and get back what its
+ * handler returns. The answer is `true' and the returned values, or `false'
+ * and an error, or `false, "timeout"' if it took longer than the optional
+ * timeout in milliseconds.
+ *
+ * Without a callback, only a handler can ask. It waits for the answer without
+ * blocking its Worker (see `actor:sleep') and `ask' returns the answer.
+ *
+ *      local ok, x, y = other:ask({"position"}, 100)
+ *
+ * With a callback, `ask' returns the id of the future at once. The callback
+ * gets the answer later, inside the Actor or on the Worker which asked.
+ *
+ *      other:ask({"position"}, function (ok, x, y) ... end, 100)
+ */
+int
+lua_actor_ask (lua_State *L)
+{
+    const int actor_arg = 1;
+    const int message_arg = 2;
+    const int id = company_actor_id(L, actor_arg);
+    int callback_arg = 3;
+    int timeout_arg = 4;
+    int asker = NODE_INVALID;
+    int thread = NODE_INVALID;
+    int timeout, future;
+
+    luaL_checktype(L, message_arg, LUA_TTABLE);
+
+    if (!lua_isfunction(L, callback_arg)) {
+        timeout_arg = callback_arg;
+        callback_arg = 0;
+    }
+
+    timeout = luaL_optint(L, timeout_arg, 0);
+
+    /* only the states of Actors have an `actor' */
+    lua_getglobal(L, "actor");
+
+    if (!lua_isnil(L, -1))
+        asker = company_actor_id(L, -1);
+
+    lua_pop(L, 1);
+
+    if (!callback_arg) {
+        if (asker == NODE_INVALID)
+            luaL_error(L, "Only a handler can wait for an answer!");
+
+        if (asker == id)
+            luaL_error(L, "Actor `%d' cannot wait for its own answer!", id);
+
+        /* actor_send sends the question when the handler is suspended */
+        lua_pushlightuserdata(L, actor_ask_marker());
+        lua_pushinteger(L, id);
+        lua_pushvalue(L, message_arg);
+        lua_pushinteger(L, timeout);
+        return lua_yield(L, 4);
+    }
+
+    if (asker == NODE_INVALID) {
+        lua_getglobal(L, "__worker_id");
+        thread = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : NODE_INVALID;
+        lua_pop(L, 1);
+
+        if (thread == NODE_INVALID)
+            luaL_error(L, "Only an Actor or a Worker can get an answer!");
+    } else {
+        thread = tree_node_thread(asker);
+    }
+
+    future = company_add_callback(L, callback_arg);
+
+    lua_pushcfunction(L, company_ask);
+    lua_pushinteger(L, id);
+    lua_pushvalue(L, message_arg);
+
+    /* {{asker, "callback", future} or {"callback", worker, future}, thread} */
+    lua_createtable(L, 2, 0);
+    lua_createtable(L, 3, 0);
+
+    if (asker == NODE_INVALID) {
+        lua_pushliteral(L, "callback");
+        lua_rawseti(L, -2, 1);
+        lua_pushinteger(L, thread);
+        lua_rawseti(L, -2, 2);
+    } else {
+        lua_pushinteger(L, asker);
+        lua_rawseti(L, -2, 1);
+        lua_pushliteral(L, "callback");
+        lua_rawseti(L, -2, 2);
+    }
+
+    lua_pushinteger(L, future);
+    lua_rawseti(L, -2, 3);
+    lua_rawseti(L, -2, 1);
+
+    if (thread > NODE_INVALID) {
+        lua_pushinteger(L, thread);
+        lua_rawseti(L, -2, 2);
+    }
+
+    lua_pushinteger(L, timeout);
+    lua_call(L, 4, 1);
+    company_set_timeout(L, future, lua_tointeger(L, -1));
+    lua_pop(L, 1);
+
+    lua_pushinteger(L, future);
+    return 1;
+}
+
+/*
+ * Handle a question from `ask' and send the reply when the handler is done.
+ * This is what the Director sends for `ask'.
+ * actor:answer({reply_action [, reply_thread]}, message)
+ */
+int
+lua_actor_answer (lua_State *L)
+{
+    const int actor_arg = 1;
+    const int id = company_actor_id(L, actor_arg);
+    company_call_actor_func(L, id, actor_answer);
+    return 0;
+}
+
+/*
+ * Call the Actor's callback with the id, given the rest of the arguments.
+ * This is how the answer to an `ask' with a callback gets back to an Actor.
+ * actor:callback(id [, arg1 [, ... [, argN]]])
+ */
+int
+lua_actor_callback (lua_State *L)
+{
+    const int actor_arg = 1;
+    const int id = company_actor_id(L, actor_arg);
+    company_call_actor_func(L, id, actor_callback);
+    return 0;
+}
+
+/*
+ * Returns the function of the Actor method with the code (see
+ * `enum ActionMethod'), which a Worker calls with the Actor and the
+ * arguments of the Action. Returns NULL for ACTION_CALL.
+ */
+lua_CFunction
+company_method (const int method)
+{
+    static const lua_CFunction methods[] = {
+        NULL, lua_actor_send, lua_actor_load, lua_actor_unload, 
+        lua_actor_resume, lua_actor_answer, lua_actor_callback
+    };
+
+    return methods[method];
+}
+
 static const luaL_Reg actor_metamethods[] = {
     {"load",     lua_actor_load},
     {"unload",   lua_actor_unload},
@@ -913,12 +1450,20 @@ static const luaL_Reg actor_metamethods[] = {
     {"send",     lua_actor_send},
     {"probe",    lua_actor_probe},
     {"async",    lua_actor_async},
+    {"async_priority", lua_actor_async_priority},
     {"audience", lua_actor_audience},
     {"yell",     lua_actor_yell},
     {"command",  lua_actor_command},
     {"say",      lua_actor_say},
     {"whisper",  lua_actor_whisper},
     {"think",    lua_actor_think},
+    {"after",    lua_actor_after},
+    {"send_by",  lua_actor_send_by},
+    {"resume",   lua_actor_resume},
+    {"sleep",    lua_actor_sleep},
+    {"ask",      lua_actor_ask},
+    {"answer",   lua_actor_answer},
+    {"callback", lua_actor_callback},
     { NULL, NULL }
 };
 
@@ -955,4 +1500,7 @@ company_set (lua_State *L)
 {
     luaL_requiref(L, "Actor", luaopen_Dialogue_Company, 1);
     lua_pop(L, 1);
+
+    lua_newtable(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, COMPANY_CALLBACKS);
 }
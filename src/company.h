@@ -41,6 +41,40 @@ company_create (int num_actors);
 void
 company_set (lua_State *L);
 
+/*
+ * Call and forget the callback with the id, given the `args' values on top of
+ * L, which are popped. A callback which was already called is ignored.
+ *
+ * Returns 0 if successful, 1 if the callback errored, which leaves the error
+ * on top of L.
+ */
+int
+company_do_callback (lua_State *L, const int id, const int args);
+
+/*
+ * Send the message to the Actor as a question. It is answered by sending the
+ * reply Action with `true' and what the handler returned appended to it, or
+ * `false' and an error. If the timeout is positive, the reply is sent with
+ * `false, "timeout"' after that many milliseconds. Whichever comes first
+ * wins, the other is ignored.
+ *
+ * Returns the handle of the timeout's Action (see `Director.after'), or -1
+ * if there is none. Whoever gets the answer first cancels it, so it doesn't
+ * sit in the Timer (and keep the Director busy) for the whole timeout.
+ *
+ * company_ask(actor, message, {reply_action [, reply_thread]} [, timeout])
+ */
+int
+company_ask (lua_State *L);
+
+/*
+ * Returns the function of the Actor method with the code (see
+ * `enum ActionMethod'), which a Worker calls with the Actor and the
+ * arguments of the Action. Returns NULL for ACTION_CALL.
+ */
+lua_CFunction
+company_method (const int method);
+
 /*
  * An actor can be represented in many ways. All of them boil down to an id.
  * This function returns the id of an actor at index. Will call lua_error on
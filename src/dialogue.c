@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include "dialogue.h"
 #include "company.h"
 #include "console.h"
@@ -7,15 +8,26 @@
 
 static int opts[] = {
     0, 4, 64, 256, 10, 
-    0, 1, 0
+    0, 1, 0,
+    DISPATCH_AFFINITY, 32, 0, 0, OVERFLOW_BLOCK, 64, 16, 5000,
+    2000
 };
 
+/* the `-a' list of CPUs the Workers are pinned to, NULL to not pin them */
+static const char *cpus = NULL;
+
 void
 dialogue_option_set (enum DialogueOption option, int value)
 {
     opts[option] = value;
 }
 
+int
+dialogue_option_get (enum DialogueOption option)
+{
+    return opts[option];
+}
+
 int
 dialogue_forced_synchronous ()
 {
@@ -28,6 +40,18 @@ dialogue_actor_manual_load ()
     return opts[ACTOR_MANUAL_LOAD];
 }
 
+void
+dialogue_set_cpus (const char *list)
+{
+    cpus = list;
+}
+
+const char *
+dialogue_cpus ()
+{
+    return cpus;
+}
+
 void
 dialogue_set_io_write (lua_State *L)
 {
@@ -35,12 +59,24 @@ dialogue_set_io_write (lua_State *L)
         console_set_write(L);
 }
 
+/*
+ * Shut down gracefully (see `director_shutdown') and then destroy the Actors.
+ * Anything the shutdown had to refuse or throw away is reported.
+ */
 int 
 dialogue_cleanup (lua_State *L)
 {
-    company_cleanup(L);
-    director_close();
+    DirectorShutdown report;
+
+    director_shutdown(L, opts[SHUTDOWN_DEADLINE], &report);
     company_close();
+
+    if (report.refused > 0 || report.dropped > 0 || report.is_late)
+        fprintf(stderr, "Dialogue: shutdown took %ldms%s, refused %d new "
+                "Actions and dropped %d queued Actions.\n", report.elapsed,
+                report.is_late ? " (past the deadline)" : "", report.refused,
+                report.dropped);
+
     return 0;
 }
 
@@ -10,7 +10,26 @@
 
 enum DialogueOption {
     WORKER_IS_MAIN, WORKER_COUNT, ACTOR_BASE, ACTOR_MAX, ACTOR_CHILD_MAX,
-    ACTOR_FORCE_SYNC, ACTOR_CONSOLE_WRITE, ACTOR_MANUAL_LOAD
+    ACTOR_FORCE_SYNC, ACTOR_CONSOLE_WRITE, ACTOR_MANUAL_LOAD,
+    DIRECTOR_DISPATCH, WORKER_BATCH, WORKER_CAPACITY, ACTOR_CAPACITY,
+    OVERFLOW_POLICY, WORKER_MAX, ACTOR_QUANTUM, SHUTDOWN_DEADLINE,
+    ACTOR_TIME_QUANTUM
+};
+
+/*
+ * How the Director picks a Worker for Actions of Actors without a thread
+ * requirement.
+ */
+enum DispatchMode {
+    DISPATCH_RANDOM, DISPATCH_AFFINITY, DISPATCH_TWO_CHOICES, DISPATCH_LEAST
+};
+
+/*
+ * What the Director does with an Action for a full mailbox, i.e. a Worker
+ * with WORKER_CAPACITY Actions queued or an Actor with ACTOR_CAPACITY.
+ */
+enum OverflowPolicy {
+    OVERFLOW_BLOCK, OVERFLOW_REJECT, OVERFLOW_DROP_NEWEST, OVERFLOW_DROP_OLDEST
 };
 
 /*
@@ -33,9 +52,25 @@ dialogue_forced_synchronous ();
 int
 dialogue_actor_manual_load ();
 
+/*
+ * Set the list of CPUs the Workers are pinned to, like "0-7" or "0,2,4-5".
+ * Worker N is pinned to the N'th CPU of the list.
+ */
+void
+dialogue_set_cpus (const char *list);
+
+/*
+ * The list of CPUs the Workers are pinned to, NULL if they aren't pinned.
+ */
+const char *
+dialogue_cpus ();
+
 void
 dialogue_option_set (enum DialogueOption option, int value);
 
+int
+dialogue_option_get (enum DialogueOption option);
+
 int
 luaopen_Dialogue (lua_State *L);
 
@@ -1,21 +1,312 @@
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>
+#include <pthread.h>
 #include "director.h"
+#include "company.h"
 #include "console.h"
 #include "worker.h"
+#include "mailbox.h"
+#include "timer.h"
 #include "utils.h"
 
+#define DIRECTOR_META "Dialogue.Director"
+
+/*
+ * In affinity mode an Actor is only moved to another Worker when its Worker
+ * has this many more Actions queued than the least loaded Worker.
+ */
+#define DIRECTOR_AFFINITY_SLACK 8
+
+/*
+ * A Worker (or the Timer) blocked by a full mailbox stops waiting after this
+ * many nanoseconds and rejects the Action instead. Two Workers waiting on each
+ * other's full mailboxes would otherwise never wake up, and every timed
+ * Action would be late.
+ */
+#define DIRECTOR_BLOCK_LIMIT 100000000L
+
+/* 
+ * Which new Actions the Director takes: all of them, only those sent by
+ * Workers, only lifecycle (high priority) ones, or none. See 
+ * `director_shutdown'.
+ */
+enum DirectorIntake {
+    INTAKE_OPEN, INTAKE_WORKERS, INTAKE_LIFECYCLE, INTAKE_CLOSED
+};
+
+/* the most pools of Workers, the default pool included */
+#define DIRECTOR_POOL_MAX 8
+#define DIRECTOR_POOL_NAME 32
+
+/* the most message names an Actor can coalesce, see `director_coalesce' */
+#define DIRECTOR_COALESCE_SLOTS 8
+
+/* the most destinations an outbox holds Actions for before it is flushed */
+#define DIRECTOR_OUTBOX_SIZE 32
+
+/* a full mailbox is either the Worker's or the Actor's */
+#define DIRECTOR_WORKER_FULL 1
+#define DIRECTOR_ACTOR_FULL  2
+
+/*
+ * A pool of Workers which only handle the Actors placed into it, so work in
+ * one pool never queues behind work in another. The default pool is the
+ * first, whose Workers are the first `worker_count' of the Director's. The
+ * named pools take their Workers from the end, see `director_add_pool'.
+ */
+typedef struct DirectorPool {
+    char name[DIRECTOR_POOL_NAME];
+    int first; /* the index of its first Worker */
+    int count; /* how many Workers it has, fixed unless it is the default */
+    int dispatch; /* how its Workers are chosen, a DispatchMode */
+    int nice; /* the nice value of its Workers' threads */
+} DirectorPool;
+
+/*
+ * The messages an Actor may coalesce: a newer copy of the message queued for
+ * the Actor makes the older ones stale, so they are skipped. Each slot holds
+ * the hash of a message name and counts its copies which are still queued.
+ */
+typedef struct DirectorCoalesce {
+    int is_all; /* every message of the Actor may be coalesced */
+    uint64_t names[DIRECTOR_COALESCE_SLOTS]; /* 0 for a free slot */
+    int is_declared[DIRECTOR_COALESCE_SLOTS];
+    int pending[DIRECTOR_COALESCE_SLOTS];
+} DirectorCoalesce;
+
+/* 
+ * How an Action reaches its Worker: through the inbox of its Actor, given to
+ * the Worker (pinned or control mailbox), or taken by it (shared mailbox).
+ */
+enum DirectorDelivery {
+    DELIVER_INBOX, DELIVER_GIVE, DELIVER_TAKE
+};
+
+/*
+ * Actions for the same destination, linked in the order they were sent so
+ * they can be pushed together. See `director_deliver'.
+ */
+typedef struct DirectorParcel {
+    int delivery; /* see `enum DirectorDelivery' */
+    int actor; /* whose inbox, for DELIVER_INBOX */
+    int priority; /* of every Action, for DELIVER_GIVE */
+    int is_pinned; /* the Actor's run token is given, for DELIVER_INBOX */
+    Worker *worker;
+    DirectorPool *pool;
+    Action *first;
+    Action *last;
+    int count;
+} DirectorParcel;
+
+/*
+ * The Actions a thread has sent but not delivered yet, while a handler runs
+ * or inside `Director.batch'. See `director_batch_begin'.
+ */
+typedef struct DirectorOutbox {
+    int depth; /* how many batches the thread is inside of */
+    int count;
+    DirectorParcel parcels[DIRECTOR_OUTBOX_SIZE];
+} DirectorOutbox;
+
 typedef struct Director {
     Worker **workers;
-    int worker_count;
-    int rand_seed;
+    DirectorPool pools[DIRECTOR_POOL_MAX];
+    int pool_count;
+    int pool_floor; /* every Worker at or past it is in a named pool */
+    int *actor_pool; /* the pool each Actor is placed in */
+    int *affinity; /* the Worker each Actor is routed to in affinity mode */
+    int *pending; /* Actions dispatched but not yet finished for each Actor */
+    Mailbox **inboxes; /* the queued Actions of each Actor */
+    Action **held; /* taken out of each inbox, earliest deadline first */
+    Action **held_last; /* the last of each Actor's held Actions */
+    int *dropping; /* oldest Actions to throw away, see `director_admit' */
+    Action **run_tokens; /* puts each Actor on a Worker's run queue */
+    int *scheduled; /* 1 while an Actor's token is queued or it's running */
+    int64_t *deficit; /* handler time each Actor has left, see `quantum' */
+    DirectorCoalesce *coalesce; /* the messages each Actor may coalesce */
+    int64_t quantum; /* handler time (ns) an Actor is given each turn */
+    int in_flight; /* Actions dispatched but not yet finished, of any Actor */
+    int intake; /* see `enum DirectorIntake' */
+    int refused; /* Actions refused because of the intake */
+    int actor_count;
+    int is_stepping; /* Actors' messages wait for the next superstep */
+    Mailbox **steps; /* each sender's messages for it, see `director_step' */
+    int has_main; /* the first Worker is run by the main thread */
+    int is_pumped; /* ...from the pumping thread's loop, see `director_pump' */
+    pthread_t pumper;
+    int worker_count; /* Workers in the pool, see `director_resize' */
+    int worker_started; /* Workers created, in or out of the pool */
+    int worker_max; /* the length of `workers' */
+    int worker_capacity; /* 0 for unbounded */
+    int actor_capacity; /* 0 for unbounded */
+    int overflow_policy;
+    DirectorOverflow overflow;
+    Timer *timer; /* sends the Actions of Director.timed and actor:after */
     struct timeval start;
     struct timeval now;
 } Director;
 
 static Director *global_director = NULL;
 
+/* only one resize of the pool at a time */
+static pthread_mutex_t resize_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* only one thread at a time runs a superstep, it alone pops `steps' */
+static pthread_mutex_t step_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* state of each thread's random number generator, see `director_random' */
+static __thread uint32_t director_seed = 0;
+
+/* each thread's Actions waiting to be delivered */
+static __thread DirectorOutbox director_outbox;
+
+/*
+ * Destroy the mailboxes of the next superstep and the Actions inside them.
+ * Returns how many Actions there were.
+ */
+static int
+director_destroy_steps ()
+{
+    int i, dropped = 0;
+
+    if (!global_director->steps)
+        return 0;
+
+    for (i = 0; i <= global_director->worker_max; i++) {
+        if (!global_director->steps[i])
+            continue;
+
+        dropped += mailbox_count(global_director->steps[i]);
+        mailbox_destroy(global_director->steps[i]);
+    }
+
+    free(global_director->steps);
+    global_director->steps = NULL;
+    return dropped;
+}
+
+/*
+ * Create a mailbox of the next superstep for every Worker and one which the
+ * other threads share, the first. Returns 0 if successful, 1 if there wasn't
+ * enough memory, which leaves nothing behind.
+ */
+static int
+director_create_steps ()
+{
+    int i;
+
+    global_director->steps = calloc(global_director->worker_max + 1, 
+            sizeof(Mailbox*));
+
+    if (!global_director->steps)
+        return 1;
+
+    for (i = 0; i <= global_director->worker_max; i++) {
+        global_director->steps[i] = mailbox_create();
+
+        if (!global_director->steps[i]) {
+            director_destroy_steps();
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Destroy the inboxes, with any Actions still inside or held, the run tokens,
+ * the deficits and the coalescing slots. A token which is still scheduled
+ * belongs to the Worker mailbox it sits in.
+ */
+static void
+director_destroy_inboxes ()
+{
+    Action *action = NULL;
+    int i;
+
+    for (i = 0; i < global_director->actor_count; i++) {
+        if (global_director->inboxes[i])
+            mailbox_destroy(global_director->inboxes[i]);
+
+        while ((action = global_director->held[i])) {
+            global_director->held[i] = action->next;
+            action_destroy(action);
+        }
+
+        if (global_director->run_tokens[i] && !global_director->scheduled[i])
+            action_destroy(global_director->run_tokens[i]);
+    }
+
+    free(global_director->coalesce);
+    free(global_director->deficit);
+    free(global_director->scheduled);
+    free(global_director->run_tokens);
+    free(global_director->dropping);
+    free(global_director->held_last);
+    free(global_director->held);
+    free(global_director->inboxes);
+}
+
+/*
+ * Create an empty inbox, a run token, a deficit and coalescing slots for
+ * every Actor. Returns 0 if successful, 1 if there wasn't enough memory,
+ * which leaves nothing behind.
+ */
+static int
+director_create_inboxes ()
+{
+    const int count = global_director->actor_count;
+    int i;
+
+    global_director->inboxes = malloc(sizeof(Mailbox*) * count);
+    global_director->held = calloc(count, sizeof(Action*));
+    global_director->held_last = calloc(count, sizeof(Action*));
+    global_director->dropping = calloc(count, sizeof(int));
+    global_director->run_tokens = malloc(sizeof(Action*) * count);
+    global_director->scheduled = malloc(sizeof(int) * count);
+    global_director->deficit = malloc(sizeof(int64_t) * count);
+    global_director->coalesce = calloc(count, sizeof(DirectorCoalesce));
+
+    if (!global_director->inboxes || !global_director->held
+            || !global_director->held_last || !global_director->dropping
+            || !global_director->run_tokens || !global_director->scheduled 
+            || !global_director->deficit || !global_director->coalesce) {
+        free(global_director->coalesce);
+        free(global_director->deficit);
+        free(global_director->scheduled);
+        free(global_director->run_tokens);
+        free(global_director->dropping);
+        free(global_director->held_last);
+        free(global_director->held);
+        free(global_director->inboxes);
+        return 1;
+    }
+
+    for (i = 0; i < count; i++) {
+        global_director->inboxes[i] = NULL;
+        global_director->run_tokens[i] = NULL;
+        global_director->scheduled[i] = 0;
+        global_director->deficit[i] = 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        global_director->inboxes[i] = mailbox_create();
+        global_director->run_tokens[i] = action_create_empty();
+
+        if (!global_director->inboxes[i] || !global_director->run_tokens[i]) {
+            director_destroy_inboxes();
+            return 1;
+        }
+
+        global_director->run_tokens[i]->actor = i;
+    }
+
+    return 0;
+}
+
 /*
  * Create the Director and N workers where N is `workers`. Each worker is 
  * allocated a mailbox and the Director itself has a mailbox for the main
@@ -33,137 +324,2755 @@ director_create (const int has_main, const int num_workers)
     if (!global_director)
         goto exit;
 
-    global_director->workers = malloc(sizeof(Worker*) * num_workers);
+    global_director->worker_max = dialogue_option_get(WORKER_MAX);
 
-    if (!global_director->workers) {
-        free(global_director);
-        goto exit;
+    if (global_director->worker_max < num_workers)
+        global_director->worker_max = num_workers;
+
+    global_director->workers = malloc(sizeof(Worker*) * 
+            global_director->worker_max);
+
+    if (!global_director->workers)
+        goto free_director;
+
+    global_director->actor_count = dialogue_option_get(ACTOR_BASE);
+    global_director->worker_capacity = dialogue_option_get(WORKER_CAPACITY);
+    global_director->actor_capacity = dialogue_option_get(ACTOR_CAPACITY);
+    global_director->overflow_policy = dialogue_option_get(OVERFLOW_POLICY);
+    global_director->quantum = (int64_t) dialogue_option_get(
+            ACTOR_TIME_QUANTUM) * 1000;
+    global_director->overflow.blocked = 0;
+    global_director->overflow.rejected = 0;
+    global_director->overflow.dropped_newest = 0;
+    global_director->overflow.dropped_oldest = 0;
+    global_director->affinity = malloc(sizeof(int) * 
+            global_director->actor_count);
+
+    if (!global_director->affinity)
+        goto free_workers;
+
+    global_director->pending = malloc(sizeof(int) * 
+            global_director->actor_count);
+
+    if (!global_director->pending)
+        goto free_affinity;
+
+    global_director->actor_pool = malloc(sizeof(int) * 
+            global_director->actor_count);
+
+    if (!global_director->actor_pool)
+        goto free_pending;
+
+    if (director_create_inboxes() != 0)
+        goto free_actor_pool;
+
+    if (director_create_steps() != 0)
+        goto destroy_inboxes;
+
+    /* Actors start spread evenly over the Workers by their id */
+    for (i = 0; i < global_director->actor_count; i++) {
+        global_director->affinity[i] = i % num_workers;
+        global_director->pending[i] = 0;
+        global_director->actor_pool[i] = 0;
     }
 
+    strcpy(global_director->pools[0].name, "default");
+    global_director->pools[0].first = 0;
+    global_director->pools[0].count = 0; /* see `director_pool_count' */
+    global_director->pools[0].dispatch = dialogue_option_get(
+            DIRECTOR_DISPATCH);
+    global_director->pools[0].nice = 0;
+    global_director->pool_count = 1;
+    global_director->pool_floor = global_director->worker_max;
+
+    /* set memory to NULL so if an error occurs, NULL checks will catch */
+    for (i = 0; i < global_director->worker_max; i++)
+        global_director->workers[i] = NULL;
+
+    global_director->worker_count = num_workers;
+    global_director->worker_started = 0;
+    global_director->has_main = has_main;
+    global_director->is_pumped = 0;
+    global_director->timer = NULL;
+    global_director->in_flight = 0;
+    global_director->is_stepping = 0;
+    global_director->intake = INTAKE_OPEN;
+    global_director->refused = 0;
+
     /* Setup a Lua state just used for its stack which acts like a mailbox */
     if (has_main) {
         /* the main thread doesn't need a thread `started`, so skip it */
+        worker_place(0);
         global_director->workers[0] = worker_create(0);
+        global_director->worker_started = 1;
         start = 1;
     }
 
-    global_director->worker_count = num_workers;
-
-    /* set memory to NULL so if an error occurs, NULL checks will catch */
-    for (i = start; i < global_director->worker_count; i++)
-        global_director->workers[i] = NULL;
-
     for (i = start; i < global_director->worker_count; i++) {
-        global_director->workers[i] = worker_start(i);
+        global_director->workers[i] = worker_start(i, 0);
 
         if (!global_director->workers[i]) {
             director_close();
             goto exit;
         }
+
+        global_director->worker_started++;
     }
 
-    global_director->rand_seed = time(NULL);
-    srand(global_director->rand_seed);
+    global_director->timer = timer_start();
+
+    if (!global_director->timer) {
+        director_close();
+        goto exit;
+    }
 
     gettimeofday(&global_director->start, NULL);
     global_director->now = global_director->start;
 
     ret = 0;
+    goto exit;
+
+destroy_inboxes:
+    director_destroy_inboxes();
+free_actor_pool:
+    free(global_director->actor_pool);
+free_pending:
+    free(global_director->pending);
+free_affinity:
+    free(global_director->affinity);
+free_workers:
+    free(global_director->workers);
+free_director:
+    free(global_director);
 exit:
     return ret;
 }
 
 /*
- * Set the `director_action` function inside the Lua state as "Director".
+ * Returns the id of the Actor at index, which is either its id or a reference
+ * object, a table with the id inside, or -1 if it can't tell. Actions aren't
+ * validated until a Worker handles them, so this never errors.
  */
-void
-director_set (lua_State *L)
+static int
+director_actor_id (lua_State *L, const int index)
 {
-    lua_pushcfunction(L, director_take_action);
-    lua_setglobal(L, "Director");
+    int id = -1;
+
+    /* Actor reference objects are tables with the id inside */
+    if (lua_type(L, index) == LUA_TTABLE) {
+        lua_rawgeti(L, index, 1);
+        id = lua_type(L, -1) == LUA_TNUMBER ? lua_tointeger(L, -1) : -1;
+        lua_pop(L, 1);
+    } else if (lua_type(L, index) == LUA_TNUMBER) {
+        id = lua_tointeger(L, index);
+    }
+
+    if (id >= global_director->actor_count)
+        id = -1;
+
+    return id;
 }
 
 /*
- * The Director takes (and pops) whatever is on top of L and gives it to a
- * Worker and does no validation. The validation occurs at the Worker level,
- * where other errors might pop up from bad inputs.
- *
- * From a random starting point (generated by the seed) 0..worker-max, we loop
- * through the workers until one isn't busy. Send the action to the open
- * worker.
- *
- * An optional thread_id can be passed which tells the director which Worker
- * process to target. If the thread_id == 1, the Director handles the message
- * itself on the main thread.
- *
- * Returns 0 if successful.
+ * Returns the id of the Actor the Action at index is for, or -1 if it can't
+ * tell, see `director_actor_id'.
  */
-int
-director_take_action (lua_State *L)
+static int
+director_action_actor (lua_State *L, const int index)
 {
-    const int thread_arg = 2;
-    int count, start, i;
-    int thread = -1;
-    int ret = 1;
+    int id = -1;
 
-    /* luaL_optint will return `-1` even if args == 2 and arg @ 2 is not an
-     * integer. This means we *must* always check the number of args to make
-     * sure the stack is balanced.
-     */
-    if (lua_gettop(L) == thread_arg) {
-        thread = luaL_optint(L, thread_arg, -1);
-        lua_pop(L, 1);
+    if (lua_type(L, index) != LUA_TTABLE)
+        return -1;
+
+    lua_rawgeti(L, index, 1);
+    id = director_actor_id(L, -1);
+    lua_pop(L, 1);
+
+    return id;
+}
+
+/*
+ * Returns the code of the method the Action at index calls (see
+ * `action_method'), ACTION_CALL if it has none or it can't tell.
+ */
+static int
+director_action_method (lua_State *L, const int index)
+{
+    int method = ACTION_CALL;
+
+    if (lua_type(L, index) != LUA_TTABLE)
+        return ACTION_CALL;
+
+    lua_rawgeti(L, index, 2);
+
+    if (lua_type(L, -1) == LUA_TSTRING)
+        method = action_method(lua_tostring(L, -1));
+
+    lua_pop(L, 1);
+    return method;
+}
+
+/*
+ * A xorshift generator whose state is kept per thread, so choosing a Worker
+ * never contends on the lock inside `rand()'. Each thread seeds itself from
+ * the time and the address of its own state.
+ */
+static inline uint32_t
+director_random ()
+{
+    uint32_t x = director_seed;
+
+    if (x == 0)
+        x = (uint32_t) time(NULL) ^ (uint32_t) (uintptr_t) &director_seed;
+
+    if (x == 0)
+        x = 1;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    director_seed = x;
+    return x;
+}
+
+/*
+ * The number of Workers in the pool. Workers with an index at or past it have
+ * been taken out of the pool by `director_resize'.
+ */
+static inline int
+director_worker_count ()
+{
+    return __atomic_load_n(&global_director->worker_count, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * The number of Workers in the pool. The default pool is resized by
+ * `director_resize', the named pools never change.
+ */
+static inline int
+director_pool_count (DirectorPool *pool)
+{
+    if (pool == global_director->pools)
+        return director_worker_count();
+
+    return pool->count;
+}
+
+/*
+ * Returns the pool the Actor is placed in.
+ */
+static inline DirectorPool *
+director_actor_pool (const int actor)
+{
+    return &global_director->pools[__atomic_load_n(
+            &global_director->actor_pool[actor], __ATOMIC_RELAXED)];
+}
+
+/*
+ * Returns the pool of the Worker at index, NULL if the Worker belongs to a
+ * named pool which is still starting.
+ */
+static DirectorPool *
+director_worker_pool (const int index)
+{
+    const int count = __atomic_load_n(&global_director->pool_count, 
+            __ATOMIC_ACQUIRE);
+    DirectorPool *pool = NULL;
+    int i;
+
+    if (index < __atomic_load_n(&global_director->pool_floor, 
+                __ATOMIC_ACQUIRE))
+        return global_director->pools;
+
+    for (i = 1; i < count; i++) {
+        pool = &global_director->pools[i];
+
+        if (index >= pool->first && index < pool->first + pool->count)
+            return pool;
     }
 
-    /* block & wait for the specific Worker (thread) to open up */
-    if (thread > -1 && thread < global_director->worker_count + 1) {
-        if (worker_give_action(global_director->workers[thread - 1], L) != 0)
-            goto error;
-        goto exit;
+    return NULL;
+}
+
+/*
+ * Returns the Worker of the thread id if it is in a pool. Returns NULL if
+ * there is no such Worker (yet) or it was taken out of the default pool.
+ */
+static inline Worker *
+director_thread_worker (const int thread)
+{
+    if (thread < 1 || thread > global_director->worker_max)
+        return NULL;
+
+    if (thread <= director_worker_count() || thread > __atomic_load_n(
+                &global_director->pool_floor, __ATOMIC_ACQUIRE))
+        return global_director->workers[thread - 1];
+
+    return NULL;
+}
+
+/*
+ * Returns the Worker at index if it has been started, whether or not it is
+ * still in the default pool, or if its named pool has been added. Otherwise
+ * NULL.
+ */
+static inline Worker *
+director_started_worker (const int index)
+{
+    DirectorPool *pool = NULL;
+
+    if (index < 0 || index >= global_director->worker_max)
+        return NULL;
+
+    if (index < __atomic_load_n(&global_director->worker_started, 
+                __ATOMIC_ACQUIRE))
+        return global_director->workers[index];
+
+    pool = director_worker_pool(index);
+
+    if (pool && pool != global_director->pools)
+        return global_director->workers[index];
+
+    return NULL;
+}
+
+/*
+ * Returns the index of the Worker of the pool with the fewest queued Actions.
+ */
+static int
+director_least_loaded (DirectorPool *pool)
+{
+    const int count = director_pool_count(pool);
+    int i, backlog, least = pool->first, least_backlog = -1;
+
+    for (i = pool->first; i < pool->first + count; i++) {
+        backlog = worker_backlog(global_director->workers[i]);
+
+        if (least_backlog < 0 || backlog < least_backlog) {
+            least = i;
+            least_backlog = backlog;
+        }
     }
 
-    count = global_director->worker_count;
-    start = rand() % count;
+    return least;
+}
 
-    /* loop forever until a Worker is available to take an Action */
-    for (i = start; i < count; i = (i + 1) % count)
-        if (worker_take_action(global_director->workers[i], L) == 0)
-            break;
+/*
+ * Returns the index of the less loaded of two Workers of the pool chosen at
+ * random. This only reads two queue depths yet keeps the deepest backlog far
+ * shorter than choosing one Worker at random does.
+ */
+static int
+director_two_choices (DirectorPool *pool)
+{
+    const int count = director_pool_count(pool);
+    const uint32_t r = director_random();
+    int first, second;
 
-exit:
-    ret = 0;
-error:
-    lua_pop(L, 1); /* the action */
-    return ret;
+    first = r % count;
+
+    if (count == 1)
+        return pool->first + first;
+
+    /* a different Worker than the first */
+    second = (first + 1 + (r >> 16) % (count - 1)) % count;
+
+    if (worker_backlog(global_director->workers[pool->first + second]) 
+            < worker_backlog(global_director->workers[pool->first + first]))
+        return pool->first + second;
+
+    return pool->first + first;
 }
 
 /*
- * This function blocks and becomes a Worker thread using the first Worker in
- * the Director's worker list. This function should only be called when
- * `has_main` passed to `director_create` was true.
+ * Returns the Worker of the pool for an Action that any of its Workers may
+ * handle, chosen by the pool's dispatch mode. Affinity mode chooses this way
+ * for Actions when it can't tell which Actor they are for.
  */
-void
-director_process_work ()
+static Worker *
+director_choose (DirectorPool *pool)
 {
-    worker_thread(global_director->workers[0]);
+    int chosen;
+
+    switch (pool->dispatch) {
+    case DISPATCH_RANDOM:
+        chosen = pool->first + director_random() % director_pool_count(pool);
+        break;
+
+    case DISPATCH_LEAST:
+        chosen = director_least_loaded(pool);
+        break;
+
+    default:
+        chosen = director_two_choices(pool);
+        break;
+    }
+
+    return global_director->workers[chosen];
 }
 
 /*
- * Close the Director and all of the Workers.
+ * Returns the Worker the Actor is routed to in affinity mode, always one of
+ * its pool.
+ *
+ * An Actor is moved to the least loaded Worker when it has nothing in
+ * flight and its current Worker has fallen behind by more than the slack,
+ * or right away when its Worker has been taken out of the pool.
  */
-void
-director_close ()
+static Worker *
+director_route (const int actor)
 {
-    int i;
+    DirectorPool *pool = director_actor_pool(actor);
+    int route = global_director->affinity[actor];
+    int backlog = worker_backlog(global_director->workers[route]);
+    const int is_removed = route >= pool->first + director_pool_count(pool);
+    int least;
 
-    /* stop everything first */
-    for (i = 0; i < global_director->worker_count; i++)
-        worker_stop(global_director->workers[i]);
+    if (backlog <= DIRECTOR_AFFINITY_SLACK && !is_removed)
+        goto exit;
 
-    /* then cleanup, it avoids a lot of problems */
-    for (i = 0; i < global_director->worker_count; i++)
-        worker_cleanup(global_director->workers[i]);
+    /* the Actor's queue goes with it, but a busy Actor's state is warm */
+    if (!is_removed && __atomic_load_n(&global_director->pending[actor], 
+                __ATOMIC_ACQUIRE))
+        goto exit;
 
-    free(global_director->workers);
-    free(global_director);
+    least = director_least_loaded(pool);
+
+    if (is_removed || worker_backlog(global_director->workers[least]) 
+            + DIRECTOR_AFFINITY_SLACK < backlog) {
+        route = least;
+        __atomic_store_n(&global_director->affinity[actor], route, 
+                __ATOMIC_RELAXED);
+    }
+
+exit:
+    return global_director->workers[route];
+}
+
+/*
+ * Returns DIRECTOR_WORKER_FULL if the Worker's backlog is at capacity,
+ * DIRECTOR_ACTOR_FULL if the Actor has as many Actions in flight as it may,
+ * and 0 if there's room.
+ */
+static inline int
+director_is_full (Worker *worker, const int actor)
+{
+    const int worker_capacity = global_director->worker_capacity;
+    const int actor_capacity = global_director->actor_capacity;
+
+    if (worker_capacity > 0 && worker_backlog(worker) >= worker_capacity)
+        return DIRECTOR_WORKER_FULL;
+
+    if (actor_capacity > 0 && actor > -1 && actor_capacity <= 
+            __atomic_load_n(&global_director->pending[actor], __ATOMIC_ACQUIRE))
+        return DIRECTOR_ACTOR_FULL;
+
+    return 0;
+}
+
+/*
+ * Wait until there's room for the Actor's Action in the Worker's mailbox,
+ * backing off from a microsecond up to a millisecond between checks.
+ *
+ * Returns 0 when there's room. Returns 1 if waiting could deadlock: the
+ * calling thread is the Worker itself, which can't drain its own mailbox
+ * while it waits, or it is another Worker (or the Timer, when is_limited)
+ * which has already waited for DIRECTOR_BLOCK_LIMIT.
+ */
+static int
+director_wait_for_room (Worker *worker, const int actor, int is_limited)
+{
+    struct timespec pause = { 0, 1000 };
+    Worker *self = worker_self();
+    long waited = 0;
+
+    if (self)
+        is_limited = 1;
+
+    if (self == worker)
+        return 1;
+
+    __atomic_add_fetch(&global_director->overflow.blocked, 1, 
+            __ATOMIC_RELAXED);
+
+    while (director_is_full(worker, actor)) {
+        if (is_limited && waited >= DIRECTOR_BLOCK_LIMIT)
+            return 1;
+
+        nanosleep(&pause, NULL);
+        waited += pause.tv_nsec;
+
+        if (pause.tv_nsec < 1000000L)
+            pause.tv_nsec *= 2;
+    }
+
+    return 0;
+}
+
+/*
+ * Apply the overflow policy if the Worker, or the Actor the Action is for,
+ * is full. Returns 0 if the Action should be pushed to the Worker. Returns 1
+ * if the Action was dropped (and destroyed). Errors through L if the Action
+ * was rejected, or drops it if L is NULL (the Timer has nobody to tell).
+ *
+ * Dropping the oldest Action is left to the consumer of the queue the new
+ * one goes into, since no other thread may pop from it: the Actor's inbox
+ * (see `director_drop_held') or the Worker's pinned or shared mailbox (see
+ * `worker_drop_oldest'). The new Action is let in right away.
+ */
+static int
+director_admit (lua_State *L, Worker *worker, Action *action, 
+        const int is_inbox, const int is_pinned)
+{
+    const int actor = action->actor;
+    const int full = director_is_full(worker, actor);
+    int *counter = NULL;
+
+    if (!full)
+        return 0;
+
+    switch (global_director->overflow_policy) {
+    case OVERFLOW_BLOCK:
+        if (director_wait_for_room(worker, actor, L == NULL) == 0)
+            return 0;
+        /* fall through, rejecting is the only safe option left */
+
+    case OVERFLOW_REJECT:
+        action_destroy(action);
+        __atomic_add_fetch(&global_director->overflow.rejected, 1, 
+                __ATOMIC_RELAXED);
+        if (!L)
+            return 1;
+        if (full == DIRECTOR_ACTOR_FULL)
+            luaL_error(L, "Director: Actor `%d' has too many Actions queued!",
+                    actor);
+        luaL_error(L, "Director: mailbox for Actor `%d' is full!", actor);
+        break;
+
+    case OVERFLOW_DROP_OLDEST:
+        if (is_inbox) {
+            __atomic_add_fetch(&global_director->dropping[actor], 1, 
+                    __ATOMIC_ACQ_REL);
+            return 0;
+        }
+
+        if (full == DIRECTOR_WORKER_FULL) {
+            worker_drop_oldest(worker, is_pinned);
+            return 0;
+        }
+        /* 
+         * fall through, the Actor has a thread requirement so its Actions
+         * are mixed with others in the Worker's mailbox and its oldest one
+         * can't be picked out
+         */
+
+    case OVERFLOW_DROP_NEWEST:
+    default:
+        counter = &global_director->overflow.dropped_newest;
+        break;
+    }
+
+    action_destroy(action);
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/*
+ * Returns ACTION_HIGH if the Action at index of L calls one of the lifecycle
+ * methods, which shouldn't wait behind a backlog of messages. Otherwise
+ * ACTION_NORMAL.
+ */
+static int
+director_action_priority (lua_State *L, const int index)
+{
+    int priority = ACTION_NORMAL;
+    const char *method = NULL;
+
+    if (lua_type(L, index) != LUA_TTABLE)
+        goto exit;
+
+    lua_rawgeti(L, index, 2);
+
+    if (lua_type(L, -1) == LUA_TSTRING) {
+        method = lua_tostring(L, -1);
+
+        if (strcmp(method, "load") == 0 || strcmp(method, "unload") == 0)
+            priority = ACTION_HIGH;
+    }
+
+    lua_pop(L, 1);
+exit:
+    return priority;
+}
+
+/*
+ * Reject the Action of an Actor whose thread requirement is a Worker that has
+ * been taken out of the pool. Errors through L, or drops the Action if L is
+ * NULL.
+ */
+static void
+director_reject_removed (lua_State *L, Action *action, const int thread)
+{
+    action_destroy(action);
+    __atomic_add_fetch(&global_director->overflow.rejected, 1, 
+            __ATOMIC_RELAXED);
+
+    if (L)
+        luaL_error(L, "Director: Worker `%d' was removed from the pool!", 
+                thread);
+}
+
+/*
+ * Returns 1 (true) if the intake doesn't let the Action in right now.
+ */
+static inline int
+director_is_refused (Action *action)
+{
+    switch (__atomic_load_n(&global_director->intake, __ATOMIC_ACQUIRE)) {
+    case INTAKE_OPEN:
+        return 0;
+
+    case INTAKE_WORKERS:
+        return worker_self() == NULL;
+
+    case INTAKE_LIFECYCLE:
+        return action->priority != ACTION_HIGH;
+
+    default:
+        return 1;
+    }
+}
+
+/*
+ * Wake up one parked Worker of the pool so it can steal Actions from a busy
+ * one.
+ */
+static void
+director_wake_idle (DirectorPool *pool)
+{
+    const int count = director_pool_count(pool);
+    int i;
+
+    for (i = pool->first; i < pool->first + count; i++)
+        if (global_director->workers[i] 
+                && worker_wake(global_director->workers[i]) == 0)
+            break;
+}
+
+/*
+ * Put the Actor on the Worker's run queue unless it is already on one or
+ * running. Pinned tokens stay with the Worker, shared ones may be stolen.
+ */
+static inline void
+director_schedule (const int actor, Worker *worker, const int is_pinned)
+{
+    int idle = 0;
+
+    if (!__atomic_compare_exchange_n(&global_director->scheduled[actor], 
+                &idle, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        return;
+
+    if (is_pinned)
+        worker_give_action(worker, global_director->run_tokens[actor]);
+    else if (worker_take_action(worker, global_director->run_tokens[actor]) 
+            > 0)
+        director_wake_idle(director_actor_pool(actor));
+}
+
+/*
+ * Push the parcel's Actions to where they go all at once, then schedule the
+ * Actor or wake the Worker once for all of them.
+ */
+static void
+director_deliver (DirectorParcel *parcel)
+{
+    switch (parcel->delivery) {
+    case DELIVER_INBOX:
+        mailbox_push_chain(global_director->inboxes[parcel->actor], 
+                parcel->first, parcel->last, parcel->count);
+        director_schedule(parcel->actor, parcel->worker, parcel->is_pinned);
+        break;
+
+    case DELIVER_GIVE:
+        worker_give_actions(parcel->worker, parcel->first, parcel->last, 
+                parcel->count);
+        break;
+
+    default:
+        /* 
+         * If the Worker already has a backlog it is busy, so wake an idle
+         * Worker to steal from it.
+         */
+        if (worker_take_actions(parcel->worker, parcel->first, parcel->last,
+                    parcel->count) > 0)
+            director_wake_idle(parcel->pool);
+        break;
+    }
+}
+
+/*
+ * Deliver every Action in the calling thread's outbox, one parcel at a time.
+ */
+static void
+director_flush ()
+{
+    int i;
+
+    for (i = 0; i < director_outbox.count; i++)
+        director_deliver(&director_outbox.parcels[i]);
+
+    director_outbox.count = 0;
+}
+
+/*
+ * Returns 1 (true) if the parcel is going to the same place as the one given
+ * by the rest of the arguments.
+ */
+static inline int
+director_is_bound (DirectorParcel *parcel, const int delivery, 
+        Worker *worker, Action *action)
+{
+    if (parcel->delivery != delivery)
+        return 0;
+
+    switch (delivery) {
+    case DELIVER_INBOX:
+        return parcel->actor == action->actor;
+
+    case DELIVER_GIVE:
+        return parcel->worker == worker 
+            && parcel->priority == action->priority;
+
+    default:
+        return parcel->worker == worker;
+    }
+}
+
+/*
+ * Add the Action to the parcel of the calling thread's outbox going the same
+ * way, or to a new parcel. A full outbox is flushed first.
+ */
+static void
+director_post (DirectorParcel *posted)
+{
+    DirectorParcel *parcel = NULL;
+    Action *action = posted->first;
+    int i;
+
+    for (i = 0; i < director_outbox.count; i++) {
+        parcel = &director_outbox.parcels[i];
+
+        if (director_is_bound(parcel, posted->delivery, posted->worker, 
+                    action)) {
+            parcel->last->next = action;
+            parcel->last = action;
+            parcel->count++;
+            return;
+        }
+    }
+
+    if (director_outbox.count == DIRECTOR_OUTBOX_SIZE)
+        director_flush();
+
+    director_outbox.parcels[director_outbox.count++] = *posted;
+}
+
+/*
+ * Returns 1 (true) while the Director runs supersteps, see `director_step'.
+ */
+static inline int
+director_is_stepping ()
+{
+    return __atomic_load_n(&global_director->is_stepping, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Keep the message for the next superstep in the mailbox of the thread which
+ * sent it, so each sender's messages stay in the order it sent them. Workers
+ * have one each, every other thread shares the first.
+ */
+static void
+director_step_post (Action *action)
+{
+    Worker *self = worker_self();
+
+    action->sent = stats_now();
+    action->next = NULL;
+
+    mailbox_push(global_director->steps[self ? worker_id(self) + 1 : 0], 
+            action);
+}
+
+/*
+ * Route the Action to a Worker and push it there, applying the overflow
+ * policy first. The Action belongs to the Worker (or is destroyed) after.
+ *
+ * Actions for an Actor without a thread requirement go into the Actor's own
+ * inbox instead, and the Actor's run token goes to the Worker.
+ *
+ * Inside a batch (see `director_batch_begin') the Action is routed, admitted
+ * and counted now but only pushed when the batch ends. While running
+ * supersteps such messages wait for the next step instead, uncounted.
+ */
+static void
+director_dispatch (lua_State *L, Action *action, const int thread)
+{
+    DirectorPool *pool = global_director->pools;
+    DirectorParcel parcel;
+    Worker *worker = NULL;
+    int is_pinned = 1;
+    int is_inbox = 0;
+
+    if (director_is_refused(action)) {
+        action_destroy(action);
+        __atomic_add_fetch(&global_director->refused, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    if (thread < 1 && action->actor > -1 && action->priority == ACTION_NORMAL
+            && director_is_stepping()) {
+        director_step_post(action);
+        return;
+    }
+
+    if (thread > 0)
+        worker = director_thread_worker(thread);
+
+    if (!worker && action->actor > -1)
+        pool = director_actor_pool(action->actor);
+
+    /* 
+     * The specific Worker (thread), which must handle the Action itself. Or
+     * in affinity mode, the Actor's own Worker, which keeps the Actor's state
+     * warm there. Otherwise any Worker of the Actor's pool. Every Action for
+     * a known Actor goes through its inbox, high priority ones too, so only
+     * the holder of the run token ever runs the Actor. High priority Actions
+     * for no Actor are never stolen, they would only wait behind the thief's
+     * own Actions.
+     */
+    if (worker) {
+        is_pinned = 1;
+    } else if (thread > 0 && thread <= global_director->worker_started) {
+        director_reject_removed(L, action, thread);
+        return;
+    } else if (pool->dispatch == DISPATCH_AFFINITY && action->actor > -1) {
+        worker = director_route(action->actor);
+        is_inbox = 1;
+    } else {
+        worker = director_choose(pool);
+        is_inbox = action->actor > -1;
+        is_pinned = !is_inbox && action->priority == ACTION_HIGH;
+    }
+
+    /* high priority Actions skip the capacity, a shutdown can't be dropped */
+    if (action->priority == ACTION_NORMAL 
+            && director_admit(L, worker, action, is_inbox, is_pinned) != 0)
+        return;
+
+    if (action->actor > -1)
+        __atomic_add_fetch(&global_director->pending[action->actor], 1, 
+                __ATOMIC_ACQ_REL);
+
+    __atomic_add_fetch(&global_director->in_flight, 1, __ATOMIC_ACQ_REL);
+
+    /* it waits in the Actor's inbox, but as part of the Worker's backlog */
+    if (is_inbox) {
+        action->worker = worker_id(worker);
+        worker_count_queued(worker, 1);
+    }
+
+    if (action->coalesce > -1)
+        __atomic_add_fetch(&global_director->coalesce[action->actor].pending[
+                action->coalesce], 1, __ATOMIC_ACQ_REL);
+
+    action->sent = stats_now();
+    action->next = NULL;
+
+    if (is_inbox)
+        parcel.delivery = DELIVER_INBOX;
+    else if (is_pinned)
+        parcel.delivery = DELIVER_GIVE;
+    else
+        parcel.delivery = DELIVER_TAKE;
+
+    parcel.actor = action->actor;
+    parcel.priority = action->priority;
+    parcel.is_pinned = is_pinned;
+    parcel.worker = worker;
+    parcel.pool = pool;
+    parcel.first = action;
+    parcel.last = action;
+    parcel.count = 1;
+
+    if (director_outbox.depth > 0)
+        director_post(&parcel);
+    else
+        director_deliver(&parcel);
+}
+
+/*
+ * A 64 bit FNV-1a hash of the message name, never 0 so it can't be mistaken
+ * for a free coalescing slot.
+ */
+static inline uint64_t
+director_hash (const char *name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (; *name; name++) {
+        hash ^= (unsigned char) *name;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash ? hash : 1;
+}
+
+/*
+ * Returns the Actor's coalescing slot of the message name with the hash. If
+ * it has none and is_claim is true, a free slot is taken for it. Returns -1
+ * if there is no slot for it.
+ */
+static int
+director_coalesce_slot (DirectorCoalesce *coalesce, const uint64_t hash, 
+        const int is_claim)
+{
+    uint64_t name;
+    int i;
+
+    for (i = 0; i < DIRECTOR_COALESCE_SLOTS; i++)
+        if (__atomic_load_n(&coalesce->names[i], __ATOMIC_ACQUIRE) == hash)
+            return i;
+
+    for (i = 0; is_claim && i < DIRECTOR_COALESCE_SLOTS; i++) {
+        name = 0;
+
+        /* a slot taken by someone else for the same message is ours too */
+        if (__atomic_compare_exchange_n(&coalesce->names[i], &name, hash, 0, 
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || name == hash)
+            return i;
+    }
+
+    return -1;
+}
+
+/*
+ * Returns the coalescing slot of the message at index if it is one the Actor
+ * may coalesce, otherwise -1. The message is what an Action sends.
+ *
+ * {"update", dt}
+ */
+static int
+director_message_slot (lua_State *L, const int index, const int actor)
+{
+    DirectorCoalesce *coalesce = NULL;
+    int i, slot = -1, is_all, is_any;
+
+    if (actor < 0)
+        return -1;
+
+    coalesce = &global_director->coalesce[actor];
+    is_all = __atomic_load_n(&coalesce->is_all, __ATOMIC_ACQUIRE);
+    is_any = is_all;
+
+    for (i = 0; i < DIRECTOR_COALESCE_SLOTS && !is_any; i++)
+        is_any = __atomic_load_n(&coalesce->is_declared[i], __ATOMIC_ACQUIRE);
+
+    /* most Actors don't coalesce, so don't bother looking at the message */
+    if (!is_any)
+        return -1;
+
+    if (lua_type(L, index) != LUA_TTABLE)
+        return -1;
+
+    lua_rawgeti(L, index, 1);
+
+    if (lua_type(L, -1) == LUA_TSTRING)
+        slot = director_coalesce_slot(coalesce, 
+                director_hash(lua_tostring(L, -1)), is_all);
+
+    if (slot > -1 && !is_all && !__atomic_load_n(&coalesce->is_declared[slot],
+                __ATOMIC_ACQUIRE))
+        slot = -1;
+
+    lua_pop(L, 1); /* the message's name */
+    return slot;
+}
+
+/*
+ * Returns how long (ns) the Action at index is worth handling after it is
+ * sent, from its `ttl' field in milliseconds. Returns 0 if it has none.
+ *
+ * {actor, "send", {"input", "up"}, ttl = 16}
+ */
+static uint64_t
+director_action_ttl (lua_State *L, const int index)
+{
+    lua_Number ttl = 0;
+
+    if (lua_type(L, index) != LUA_TTABLE)
+        return 0;
+
+    lua_getfield(L, index, "ttl");
+    ttl = lua_tonumber(L, -1);
+    lua_pop(L, 1);
+
+    return ttl > 0 ? (uint64_t) (ttl * 1000000) : 0;
+}
+
+/*
+ * Serialize the Action calling the method of the Actor, which is the first
+ * of the `count' values from index of L, the rest being its arguments. Find
+ * the Actor's id and the coalescing slot of the message it sends.
+ * Errors through L if there isn't enough memory.
+ */
+static Action *
+director_create_call (lua_State *L, const int method, const int index, 
+        const int count)
+{
+    const int first = lua_absindex(L, index);
+    Action *action = action_create_values(L, first, count);
+
+    if (!action)
+        luaL_error(L, "Director: not enough memory for the Action!");
+
+    action->method = method;
+    action->actor = director_actor_id(L, first);
+
+    if (method == ACTION_SEND && count > 1)
+        action->coalesce = director_message_slot(L, first + 1, action->actor);
+
+    return action;
+}
+
+/*
+ * Serialize the Action at action_arg of L and find the Actor it is for, the
+ * coalescing slot of its message and its time to live. An Action calling a
+ * method with a code (see `action_method') only holds the Actor and the
+ * arguments.
+ * Errors through L if there isn't enough memory.
+ */
+static Action *
+director_create_action (lua_State *L, const int action_arg)
+{
+    const int method = director_action_method(L, action_arg);
+    const int top = lua_gettop(L);
+    Action *action = NULL;
+    int i, length;
+
+    if (method == ACTION_CALL) {
+        action = action_create(L, action_arg);
+
+        if (!action)
+            luaL_error(L, "Director: not enough memory for the Action!");
+
+        action->actor = director_action_actor(L, action_arg);
+        goto exit;
+    }
+
+    /* {actor, method, arg1, ..., argN} => actor, arg1, ..., argN */
+    length = lua_rawlen(L, action_arg);
+    luaL_checkstack(L, length, "Director: too many arguments for the Action!");
+    lua_rawgeti(L, action_arg, 1);
+
+    for (i = 3; i <= length; i++)
+        lua_rawgeti(L, action_arg, i);
+
+    action = director_create_call(L, method, top + 1, lua_gettop(L) - top);
+    lua_settop(L, top);
+
+exit:
+    action->ttl = director_action_ttl(L, action_arg);
+    return action;
+}
+
+/*
+ * The Director takes (and pops) whatever is on top of L and gives it to a
+ * Worker and does no validation. The validation occurs at the Worker level,
+ * where other errors might pop up from bad inputs.
+ *
+ * The Action is serialized once here and pushed into the inbox of the Actor
+ * it is for. The Actor itself (its run token) is put on a Worker's run queue
+ * if it isn't on one already, and only that Worker handles the Actor's
+ * Actions until it releases it. So an Actor's Actions are handled in order
+ * and Workers never wait on each other for the same Actor. Mailboxes never
+ * block, so there is no need to look for one that isn't busy. The Worker is
+ * chosen by queue depth (DISPATCH_TWO_CHOICES or DISPATCH_LEAST) or at
+ * random (DISPATCH_RANDOM). Idle Workers steal runnable Actors from busy
+ * ones.
+ *
+ * In affinity mode (DISPATCH_AFFINITY) an Actor always runs on the same
+ * Worker instead, which only moves the Actor when it falls behind. Those
+ * Actors are not stolen.
+ *
+ * Actions which aren't for a known Actor, or have a thread requirement, skip
+ * the inboxes and go straight to a Worker's mailbox. High priority Actions
+ * for an Actor go through its inbox but skip ahead of its normal ones.
+ *
+ * An optional thread_id can be passed which tells the director which Worker
+ * process to target. If the thread_id == 1, the Director handles the message
+ * itself on the main thread.
+ *
+ * When the Worker's mailbox or the Actor's queue is at capacity, the
+ * overflow policy decides whether the caller blocks, gets an error, or an
+ * Action is dropped. See `director_overflow'.
+ *
+ * Calls of the lifecycle methods `load' and `unload' have a high priority.
+ * They skip ahead of every normal Action queued for the Worker and aren't
+ * held back by the overflow policy.
+ *
+ * An Action with a `ttl' field is only worth handling for that many
+ * milliseconds after it is sent. Workers drop it unhandled once that has
+ * passed, and an Actor's queued Actions are handled earliest deadline first.
+ * That can put it ahead of Actions its sender sent earlier, the order they
+ * were sent in only holds among those with the same deadline, or none.
+ *
+ * Errors through L if there isn't enough memory for the Action or if the
+ * Action was rejected by the overflow policy.
+ */
+int
+director_take_action (lua_State *L)
+{
+    const int action_arg = 1;
+    const int thread_arg = 2;
+    Action *action = NULL;
+    int thread = -1;
+
+    /* luaL_optint will return `-1` even if args == 2 and arg @ 2 is not an
+     * integer. This means we *must* always check the number of args to make
+     * sure the stack is balanced.
+     */
+    if (lua_gettop(L) == thread_arg) {
+        thread = luaL_optint(L, thread_arg, -1);
+        lua_pop(L, 1);
+    }
+
+    action = director_create_action(L, action_arg);
+    action->priority = director_action_priority(L, action_arg);
+    director_dispatch(L, action, thread);
+
+    lua_pop(L, 1); /* the action */
+    return 0;
+}
+
+/*
+ * Director.priority(action, priority [, thread_id])
+ *
+ * Take the Action like `director_take_action' but with the given priority,
+ * either "high" or "normal", rather than one based on its method.
+ */
+int
+director_take_priority_action (lua_State *L)
+{
+    static const char *priorities[] = { "normal", "high", NULL };
+    const int action_arg = 1;
+    const int priority_arg = 2;
+    const int thread_arg = 3;
+    Action *action = NULL;
+    int priority = luaL_checkoption(L, priority_arg, NULL, priorities);
+    int thread = -1;
+
+    if (lua_gettop(L) == thread_arg)
+        thread = luaL_optint(L, thread_arg, -1);
+
+    lua_settop(L, action_arg);
+
+    action = director_create_action(L, action_arg);
+    action->priority = priority == 1 ? ACTION_HIGH : ACTION_NORMAL;
+    director_dispatch(L, action, thread);
+
+    lua_pop(L, 1); /* the action */
+    return 0;
+}
+
+/*
+ * Take an Action calling the method (see `enum ActionMethod') of the Actor,
+ * which is the first of the `count' values from index of L, the rest being
+ * its arguments. It is taken like `director_take_action' takes
+ * {actor, method, arg1, ..., argN}, but no table is built for it. The
+ * priority is ACTION_NORMAL, ACTION_HIGH or -1 for one based on the method.
+ * Nothing is popped.
+ *
+ * Errors through L like `director_take_action'.
+ */
+void
+director_take_call (lua_State *L, const int method, const int index, 
+        const int count, const int priority, const int thread)
+{
+    Action *action = director_create_call(L, method, index, count);
+
+    if (priority > -1)
+        action->priority = priority;
+    else if (method == ACTION_LOAD || method == ACTION_UNLOAD)
+        action->priority = ACTION_HIGH;
+
+    director_dispatch(L, action, thread);
+}
+
+/*
+ * Director.after(delay, action [, thread])
+ *
+ * Take the Action once after `delay' milliseconds. Returns the handle for
+ * `Director.cancel'. The Action is in flight while it waits, so
+ * `Director.wait_idle' waits for it too.
+ *
+ * Once shutting down has begun, the Timer's Actions would be refused when
+ * they're sent, so the Action is refused now and the handle is -1.
+ */
+int
+director_take_delayed_action (lua_State *L)
+{
+    const int delay_arg = 1;
+    const int action_arg = 2;
+    const int thread_arg = 3;
+    const int delay = luaL_checkint(L, delay_arg);
+    const int thread = luaL_optint(L, thread_arg, -1);
+    Action *action = director_create_action(L, action_arg);
+    int handle = -1;
+
+    action->priority = director_action_priority(L, action_arg);
+
+    if (__atomic_load_n(&global_director->intake, __ATOMIC_ACQUIRE) 
+            != INTAKE_OPEN) {
+        action_destroy(action);
+        __atomic_add_fetch(&global_director->refused, 1, __ATOMIC_RELAXED);
+        goto exit;
+    }
+
+    __atomic_add_fetch(&global_director->in_flight, 1, __ATOMIC_ACQ_REL);
+    handle = timer_after(global_director->timer, action, thread, delay);
+
+    if (handle < 0) {
+        director_finish_action(-1);
+        action_destroy(action);
+        luaL_error(L, "Director: not enough memory for the delayed Action!");
+    }
+
+exit:
+    lua_pushinteger(L, handle);
+    return 1;
+}
+
+/*
+ * Take an Action which was already serialized, like one sent by the Timer.
+ * The thread requirement is the same as `director_take_action'. The Action is
+ * dropped if the overflow policy rejects it.
+ */
+void
+director_give_action (Action *action, const int thread)
+{
+    director_dispatch(NULL, action, thread);
+}
+
+/*
+ * Returns the id of the Actor if the Action is its run token, otherwise -1.
+ */
+int
+director_run_token (Action *action)
+{
+    const int actor = action->actor;
+
+    if (actor > -1 && actor < global_director->actor_count 
+            && global_director->run_tokens[actor] == action)
+        return actor;
+
+    return -1;
+}
+
+/*
+ * The Action left the queue of its Actor, so it no longer counts towards the
+ * backlog of the Worker it was dispatched to.
+ */
+static inline void
+director_uncount (Action *action)
+{
+    if (action->worker < 0)
+        return;
+
+    worker_count_queued(global_director->workers[action->worker], -1);
+    action->worker = -1;
+}
+
+/*
+ * Hold the Action taken out of the Actor's inbox in deadline order. Actions
+ * with the same deadline, or none, keep the order they arrived in, so
+ * holding an Action without a time to live never has to walk the list.
+ *
+ * High priority Actions are a lane of their own at the front, in the order
+ * they arrived, which is drained before any normal Action.
+ */
+static void
+director_hold (const int actor, Action *action)
+{
+    Action **held = &global_director->held[actor];
+    Action **last = &global_director->held_last[actor];
+    const uint64_t deadline = action_deadline(action);
+
+    action->next = NULL;
+
+    if (action->priority == ACTION_HIGH) {
+        while (*held && (*held)->priority == ACTION_HIGH)
+            held = &(*held)->next;
+
+        if (!*held)
+            *last = action;
+
+        action->next = *held;
+        *held = action;
+        return;
+    }
+
+    if (!*held || (*last)->priority == ACTION_HIGH 
+            || action_deadline(*last) <= deadline) {
+        if (*held)
+            (*last)->next = action;
+        else
+            *held = action;
+
+        *last = action;
+        return;
+    }
+
+    while ((*held)->priority == ACTION_HIGH 
+            || action_deadline(*held) <= deadline)
+        held = &(*held)->next;
+
+    action->next = *held;
+    *held = action;
+}
+
+/*
+ * Throw away the Actor's oldest held Actions for as many times as the
+ * drop-oldest policy asked (see `director_admit'). The last normal Action
+ * is never thrown away: if only one is left, the Actor has handled its
+ * backlog in the meantime, so the rest of the requests are forgotten.
+ */
+static void
+director_drop_held (const int actor)
+{
+    int *dropping = &global_director->dropping[actor];
+    Action *action, *prev, *oldest, *oldest_prev;
+    int count;
+
+    while (__atomic_load_n(dropping, __ATOMIC_ACQUIRE) > 0) {
+        oldest = oldest_prev = prev = NULL;
+        count = 0;
+
+        for (action = global_director->held[actor]; action; 
+                prev = action, action = action->next) {
+            if (action->priority != ACTION_NORMAL)
+                continue;
+
+            if (!oldest || action->sent < oldest->sent) {
+                oldest = action;
+                oldest_prev = prev;
+            }
+
+            count++;
+        }
+
+        if (count < 2) {
+            __atomic_store_n(dropping, 0, __ATOMIC_RELEASE);
+            break;
+        }
+
+        if (oldest_prev)
+            oldest_prev->next = oldest->next;
+        else
+            global_director->held[actor] = oldest->next;
+
+        if (global_director->held_last[actor] == oldest)
+            global_director->held_last[actor] = oldest_prev;
+
+        __atomic_sub_fetch(dropping, 1, __ATOMIC_ACQ_REL);
+        director_drop_oldest(oldest);
+    }
+}
+
+/*
+ * Pop the Action of the Actor with the earliest deadline, or the oldest if
+ * none have one. Everything in the Actor's inbox is taken out and held in
+ * deadline order first. Only the Worker which popped the Actor's run token
+ * may call this, until it releases the Actor. Returns NULL if the Actor has
+ * nothing queued (or a push into its inbox hasn't finished).
+ */
+Action *
+director_inbox_action (const int actor)
+{
+    Mailbox *inbox = global_director->inboxes[actor];
+    Action *action = NULL;
+
+    while ((action = mailbox_pop(inbox)))
+        director_hold(actor, action);
+
+    if (__atomic_load_n(&global_director->dropping[actor], __ATOMIC_ACQUIRE))
+        director_drop_held(actor);
+
+    action = global_director->held[actor];
+
+    if (action) {
+        global_director->held[actor] = action->next;
+        action->next = NULL;
+        director_uncount(action);
+    }
+
+    return action;
+}
+
+/*
+ * Start the turn of the Actor whose run token the calling Worker popped, 
+ * deficit round robin style. The Actor is given the quantum of handler time,
+ * on top of whatever it owes from turns which ran over it, but it can't save
+ * up more than one quantum. Returns 1 if it has time left to run now, 0 if it
+ * must wait for its next turn to pay off the rest of what it owes.
+ *
+ * Without a time quantum (ACTOR_TIME_QUANTUM of 0) every turn may run, and
+ * so does every turn of a superstep, which would otherwise depend on timing.
+ */
+int
+director_begin_turn (const int actor)
+{
+    const int64_t quantum = global_director->quantum;
+    int64_t *deficit = &global_director->deficit[actor];
+
+    if (quantum == 0 || director_is_stepping())
+        return 1;
+
+    *deficit += quantum;
+
+    if (*deficit > quantum)
+        *deficit = quantum;
+
+    return *deficit > 0;
+}
+
+/*
+ * Charge the Actor the Worker is running for `elapsed' nanoseconds of
+ * handler time. Returns 1 if the Actor has time left in its turn, 0 if its
+ * turn is over.
+ */
+int
+director_charge_actor (const int actor, const uint64_t elapsed)
+{
+    if (global_director->quantum == 0 || director_is_stepping())
+        return 1;
+
+    global_director->deficit[actor] -= (int64_t) elapsed;
+    return global_director->deficit[actor] > 0;
+}
+
+/*
+ * The calling Worker is done running the Actor for now. If the Actor has more
+ * Actions, its run token goes to the back of a run queue, otherwise it is
+ * unscheduled until its next Action arrives. During a superstep the token
+ * stays with the Worker, so nothing is stolen.
+ */
+void
+director_release_actor (const int actor)
+{
+    Mailbox *inbox = global_director->inboxes[actor];
+    DirectorPool *pool = director_actor_pool(actor);
+    Worker *worker = worker_self();
+    int idle = 0;
+
+    if (mailbox_count(inbox) == 0 && !global_director->held[actor]) {
+        /* an idle Actor loses its credit, but not what it owes */
+        if (global_director->deficit[actor] > 0)
+            global_director->deficit[actor] = 0;
+
+        __atomic_store_n(&global_director->scheduled[actor], 0, 
+                __ATOMIC_SEQ_CST);
+
+        /* 
+         * An Action pushed before the flag was cleared saw it set and didn't
+         * schedule the Actor, so it is up to us.
+         */
+        if (mailbox_count(inbox) == 0 
+                || !__atomic_compare_exchange_n(
+                    &global_director->scheduled[actor], &idle, 1, 0, 
+                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            return;
+    }
+
+    /* a Worker taken out of the pool doesn't keep its Actors */
+    if (pool == global_director->pools 
+            && worker_id(worker) >= director_worker_count())
+        worker = director_choose(pool);
+
+    if (director_is_stepping())
+        worker_give_action(worker, global_director->run_tokens[actor]);
+    else if (pool->dispatch == DISPATCH_AFFINITY)
+        worker_give_action(director_route(actor), 
+                global_director->run_tokens[actor]);
+    else if (worker_take_action(worker, global_director->run_tokens[actor]) 
+            > 0)
+        director_wake_idle(pool);
+}
+
+/*
+ * A Worker drained the Action from a mailbox. Returns 1 (true) if it is a
+ * message the Actor coalesces and a newer copy of it is queued behind it, so
+ * it is stale and can be skipped. Must be called once for each drained
+ * Action, skipped or not.
+ */
+int
+director_is_stale (Action *action)
+{
+    if (action->coalesce < 0 || action->actor < 0)
+        return 0;
+
+    return __atomic_sub_fetch(&global_director->coalesce[action->actor].pending[
+            action->coalesce], 1, __ATOMIC_ACQ_REL) > 0;
+}
+
+/*
+ * Let the Actor coalesce the message with the name, or every message if it
+ * is NULL. An Actor can coalesce up to DIRECTOR_COALESCE_SLOTS different
+ * messages, any others are always handled.
+ */
+void
+director_coalesce (const int actor, const char *message)
+{
+    DirectorCoalesce *coalesce = NULL;
+    int slot;
+
+    if (actor < 0 || actor >= global_director->actor_count)
+        return;
+
+    coalesce = &global_director->coalesce[actor];
+
+    if (!message) {
+        __atomic_store_n(&coalesce->is_all, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    slot = director_coalesce_slot(coalesce, director_hash(message), 1);
+
+    if (slot > -1)
+        __atomic_store_n(&coalesce->is_declared[slot], 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Stop the Actor from coalescing any messages, e.g. before its Scripts are
+ * reloaded. Copies already queued are still counted.
+ */
+void
+director_coalesce_clear (const int actor)
+{
+    DirectorCoalesce *coalesce = NULL;
+    int i;
+
+    if (actor < 0 || actor >= global_director->actor_count)
+        return;
+
+    coalesce = &global_director->coalesce[actor];
+    __atomic_store_n(&coalesce->is_all, 0, __ATOMIC_RELEASE);
+
+    for (i = 0; i < DIRECTOR_COALESCE_SLOTS; i++)
+        __atomic_store_n(&coalesce->is_declared[i], 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Hold back the Actions the calling thread sends until the matching
+ * `director_batch_end'. Batches nest, only the outermost one delivers.
+ */
+void
+director_batch_begin ()
+{
+    director_outbox.depth++;
+}
+
+/*
+ * End the calling thread's batch. If it is the outermost, every Action sent
+ * during it is delivered: the Actions for one Actor's inbox, or one of a
+ * Worker's mailboxes, are pushed together and the Actor is scheduled, or the
+ * Worker woken, only once.
+ *
+ * A Worker's capacity is checked as each Action is sent, so the Actions
+ * still in an outbox can go past it by a batch's worth.
+ */
+void
+director_batch_end ()
+{
+    if (director_outbox.depth > 0 && --director_outbox.depth > 0)
+        return;
+
+    director_flush();
+}
+
+/*
+ * A Worker has finished handling an Action for the Actor with the given id.
+ */
+void
+director_finish_action (const int actor)
+{
+    if (actor > -1)
+        __atomic_sub_fetch(&global_director->pending[actor], 1, 
+                __ATOMIC_ACQ_REL);
+
+    __atomic_sub_fetch(&global_director->in_flight, 1, __ATOMIC_ACQ_REL);
+}
+
+/*
+ * Throw away the Action the drop-oldest policy picked to make room in a full
+ * queue. Only the queue's consumer may call this, the Action was counted as
+ * dispatched so it is finished here.
+ */
+void
+director_drop_oldest (Action *action)
+{
+    director_uncount(action);
+    director_is_stale(action); /* it still counts as a queued copy */
+    director_finish_action(action->actor);
+    action_destroy(action);
+    __atomic_add_fetch(&global_director->overflow.dropped_oldest, 1, 
+            __ATOMIC_RELAXED);
+}
+
+/*
+ * Director.batch(function [, arg1 [, ... [, argN]]])
+ *
+ * Call the function with the arguments and deliver every Action it sends
+ * once it returns (or errors), one push for each Actor or Worker they go
+ * to. Returns whatever the function returns. A handler's Actions are always
+ * batched like this.
+ *
+ * The function can't yield, so it can't `ask' either: the batch belongs to
+ * the calling thread, and a coroutine may be resumed on another one long
+ * after. Yielding raises an error instead, and what was sent before it
+ * still goes.
+ */
+static int
+lua_director_batch (lua_State *L)
+{
+    const int function_arg = 1;
+    int status;
+
+    luaL_checktype(L, function_arg, LUA_TFUNCTION);
+
+    director_batch_begin();
+    status = lua_pcall(L, lua_gettop(L) - function_arg, LUA_MULTRET, 0);
+    director_batch_end();
+
+    if (status != 0)
+        return lua_error(L);
+
+    return lua_gettop(L);
+}
+
+/*
+ * Director.wait_idle([timeout])
+ * Director.flush([timeout])
+ *
+ * Block until every Action sent so far, and every Action those sent in turn,
+ * has been handled: nothing is queued, waiting to be sent after a delay or
+ * being handled. Periodic Actions (`Director.timed') are only waited for
+ * once they're sent. Returns true once idle, false if `timeout'
+ * milliseconds passed first. Without a timeout it waits for as long as it
+ * takes. Handlers can't wait, they would wait on themselves.
+ *
+ *      a0:yell{"reset"}
+ *      Director.wait_idle()
+ */
+static int
+lua_director_wait_idle (lua_State *L)
+{
+    const int timeout = luaL_optint(L, 1, -1);
+
+    if (worker_self())
+        luaL_error(L, "Director: a handler can't wait for the Workers!");
+
+    lua_pushboolean(L, director_wait_idle(timeout) == 0);
+    return 1;
+}
+
+/*
+ * Director.step()
+ *
+ * Run one superstep (see `director_step') and return how many messages the
+ * Actors were handed in it. From the first step on, or from
+ * `Director.begin_steps', the messages an Actor is sent wait for the next
+ * step. Handlers can't run a step, it would wait on them.
+ *
+ *      Director.begin_steps()
+ *      a0:yell{"update"}
+ *      while Director.step() > 0 do end
+ */
+static int
+lua_director_step (lua_State *L)
+{
+    if (worker_self())
+        luaL_error(L, "Director: a handler can't run a step!");
+
+    lua_pushinteger(L, director_step());
+    return 1;
+}
+
+/*
+ * Director.begin_steps()
+ *
+ * Start running supersteps, so the messages sent from now on are kept for
+ * the first `Director.step'.
+ */
+static int
+lua_director_begin_steps (lua_State *L)
+{
+    director_begin_steps();
+    return 0;
+}
+
+/*
+ * Director.run_steps(n)
+ *
+ * Run up to n supersteps, stopping early after a step in which nothing was
+ * sent, since the steps after it would have nothing to do. Returns how many
+ * steps handed the Actors any messages.
+ */
+static int
+lua_director_run_steps (lua_State *L)
+{
+    const int count = luaL_checkint(L, 1);
+    int i;
+
+    luaL_argcheck(L, count >= 0, 1, "can't be negative");
+
+    if (worker_self())
+        luaL_error(L, "Director: a handler can't run a step!");
+
+    for (i = 0; i < count; i++)
+        if (director_step() == 0)
+            break;
+
+    lua_pushinteger(L, i);
+    return 1;
+}
+
+/*
+ * Director.end_steps()
+ *
+ * Stop running supersteps once the current one is done. The messages kept
+ * for the next step are handled right away, as are those sent from then on.
+ * Returns how many messages were kept.
+ */
+static int
+lua_director_end_steps (lua_State *L)
+{
+    if (worker_self())
+        luaL_error(L, "Director: a handler can't run a step!");
+
+    lua_pushinteger(L, director_end_steps(-1));
+    return 1;
+}
+
+/*
+ * Director.pump([max_ms [, max_actions]])
+ *
+ * Handle the Actions of the main thread's Worker (see `-m') right here, for
+ * up to max_ms milliseconds or max_actions Actions, and return how many were
+ * taken once nothing is queued for it. A script run with `-e' calls this
+ * from its own loop:
+ *
+ *      while running do
+ *          poll_input()
+ *          Director.pump(4)
+ *          draw()
+ *      end
+ */
+static int
+lua_director_pump (lua_State *L)
+{
+    const int max_ms = luaL_optint(L, 1, 0);
+    const int max_actions = luaL_optint(L, 2, 0);
+    const int taken = director_pump(max_ms, max_actions);
+
+    if (taken < 0)
+        luaL_error(L, "Director: no main thread Worker this thread can pump!");
+
+    lua_pushinteger(L, taken);
+    return 1;
+}
+
+/*
+ * Director{ action [, thread] }
+ *
+ * The Director's table can be called directly to take an Action.
+ */
+static int
+lua_director_call (lua_State *L)
+{
+    lua_remove(L, 1); /* the Director's table */
+    return director_take_action(L);
+}
+
+/*
+ * Director.overflow()
+ *
+ * Returns a table counting what each overflow policy has done with Actions
+ * that arrived at a full mailbox.
+ */
+static int
+lua_director_overflow (lua_State *L)
+{
+    DirectorOverflow overflow;
+
+    director_overflow(&overflow);
+
+    lua_newtable(L);
+    lua_pushinteger(L, overflow.blocked);
+    lua_setfield(L, -2, "blocked");
+    lua_pushinteger(L, overflow.rejected);
+    lua_setfield(L, -2, "rejected");
+    lua_pushinteger(L, overflow.dropped_newest);
+    lua_setfield(L, -2, "dropped_newest");
+    lua_pushinteger(L, overflow.dropped_oldest);
+    lua_setfield(L, -2, "dropped_oldest");
+    return 1;
+}
+
+/*
+ * Director.timed(rate, period, action [, thread])
+ *
+ * Take the Action `rate' times every `period' milliseconds until cancelled.
+ * Returns the handle for `Director.cancel'.
+ *
+ * Director.timed(30, 1000, {actor, "send", {"update"}})
+ */
+static int
+lua_director_timed (lua_State *L)
+{
+    const int rate_arg = 1;
+    const int period_arg = 2;
+    const int action_arg = 3;
+    const int thread_arg = 4;
+    const int rate = luaL_checkint(L, rate_arg);
+    const int period = luaL_checkint(L, period_arg);
+    const int thread = luaL_optint(L, thread_arg, -1);
+    Action *action = NULL;
+    int handle;
+
+    luaL_argcheck(L, rate > 0, rate_arg, "must be positive");
+    luaL_argcheck(L, period > 0, period_arg, "must be positive");
+
+    action = director_create_action(L, action_arg);
+    action->priority = director_action_priority(L, action_arg);
+    handle = timer_every(global_director->timer, action, thread, rate, period);
+
+    if (handle < 0) {
+        action_destroy(action);
+        luaL_error(L, "Director: not enough memory for the timed Action!");
+    }
+
+    lua_pushinteger(L, handle);
+    return 1;
+}
+
+/*
+ * Cancel the Action waiting on the Timer with the handle, see
+ * `director_take_delayed_action'. Returns 1 if it was cancelled, 0 if it had
+ * already been sent or cancelled (or the handle is -1).
+ */
+int
+director_cancel (const int handle)
+{
+    /* the Timer stops before the Workers, whose handlers may still cancel */
+    if (__atomic_load_n(&global_director->intake, __ATOMIC_ACQUIRE) 
+            == INTAKE_CLOSED)
+        return 0;
+
+    return timer_cancel(global_director->timer, handle);
+}
+
+/*
+ * Director.cancel(handle)
+ *
+ * Cancel an Action of `Director.timed' or `Director.after'. Returns true if
+ * it was cancelled, false if it had already been sent or cancelled.
+ */
+static int
+lua_director_cancel (lua_State *L)
+{
+    const int handle = luaL_checkint(L, 1);
+    lua_pushboolean(L, director_cancel(handle));
+    return 1;
+}
+
+/*
+ * Director.pin(thread, cpus)
+ *
+ * Pin the Worker of the thread to the CPUs in a list like "0-3,8". Returns
+ * true if it was pinned.
+ *
+ * Director.pin(2, "4-7")
+ */
+static int
+lua_director_pin (lua_State *L)
+{
+    const int thread = luaL_checkint(L, 1);
+    const char *list = luaL_checkstring(L, 2);
+    Worker *worker = NULL;
+
+    worker = director_thread_worker(thread);
+    luaL_argcheck(L, worker, 1, "not a Worker's thread");
+
+    lua_pushboolean(L, worker_pin(worker, list) == 0);
+    return 1;
+}
+
+/*
+ * Director.workers([count])
+ *
+ * Resize the pool of Workers to count, see `director_resize'. Returns the
+ * size of the pool, which is all it does without a count.
+ */
+static int
+lua_director_workers (lua_State *L)
+{
+    int count;
+
+    if (lua_isnoneornil(L, 1))
+        count = director_worker_count();
+    else
+        count = director_resize(luaL_checkint(L, 1));
+
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+/*
+ * Director.pool(name [, size [, priority [, dispatch]]])
+ *
+ * Start a named pool of `size' Workers, see `director_add_pool'. Its threads
+ * have the "high", "normal" (the default) or "low" priority and it
+ * dispatches like the `-d' option ("affinity", "two", "least" or "random"),
+ * by default like the default pool. Returns the size of the pool, nil if
+ * there is no pool with the name, which is all it does without a size.
+ * Actors are placed into a pool by giving its name instead of a thread.
+ *
+ * Director.pool("render", 1, "high")
+ * renderer = actor:child({ {"draw"} }, "render")
+ */
+static int
+lua_director_pool (lua_State *L)
+{
+    static const char *priorities[] = { "high", "normal", "low", NULL };
+    static const int nice[] = { -5, 0, 10 };
+    static const char *modes[] = { "random", "affinity", "two", "least", NULL };
+    const int name_arg = 1;
+    const int size_arg = 2;
+    const int priority_arg = 3;
+    const int dispatch_arg = 4;
+    const char *name = luaL_checkstring(L, name_arg);
+    int pool = director_pool_id(name);
+    int priority, dispatch;
+
+    if (lua_isnoneornil(L, size_arg)) {
+        if (pool == -1)
+            lua_pushnil(L);
+        else
+            lua_pushinteger(L, 
+                    director_pool_count(&global_director->pools[pool]));
+        return 1;
+    }
+
+    priority = luaL_checkoption(L, priority_arg, "normal", priorities);
+    dispatch = lua_isnoneornil(L, dispatch_arg) 
+        ? global_director->pools[0].dispatch
+        : luaL_checkoption(L, dispatch_arg, NULL, modes);
+
+    switch (director_add_pool(name, luaL_checkint(L, size_arg), 
+                nice[priority], dispatch)) {
+    case 1:
+        luaL_error(L, "Director: can't add pool `%s', it exists or there's "
+                "no room for it (see WORKER_MAX)!", name);
+        break;
+
+    case 2:
+        luaL_error(L, "Director: couldn't start the Workers of pool `%s'!",
+                name);
+        break;
+    }
+
+    lua_pushinteger(L, luaL_checkint(L, size_arg));
+    return 1;
+}
+
+/*
+ * Push a table of the Histogram's count, median, 90th and 99th percentiles
+ * and maximum in microseconds.
+ */
+static void
+director_push_histogram (lua_State *L, Histogram *histogram)
+{
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, histogram->total);
+    lua_setfield(L, -2, "count");
+    lua_pushnumber(L, stats_percentile(histogram, 50) / 1000.0);
+    lua_setfield(L, -2, "p50");
+    lua_pushnumber(L, stats_percentile(histogram, 90) / 1000.0);
+    lua_setfield(L, -2, "p90");
+    lua_pushnumber(L, stats_percentile(histogram, 99) / 1000.0);
+    lua_setfield(L, -2, "p99");
+    lua_pushnumber(L, histogram->max / 1000.0);
+    lua_setfield(L, -2, "max");
+}
+
+/*
+ * Push a table of the Stats, with times in microseconds.
+ */
+static void
+director_push_stats (lua_State *L, Stats *stats)
+{
+    lua_createtable(L, 0, 9);
+    lua_pushnumber(L, stats->processed);
+    lua_setfield(L, -2, "processed");
+    lua_pushnumber(L, stats->failed);
+    lua_setfield(L, -2, "failed");
+    lua_pushnumber(L, stats->coalesced);
+    lua_setfield(L, -2, "coalesced");
+    lua_pushnumber(L, stats->expired);
+    lua_setfield(L, -2, "expired");
+    lua_pushinteger(L, stats->depth);
+    lua_setfield(L, -2, "depth");
+    lua_pushnumber(L, stats->idle / 1000.0);
+    lua_setfield(L, -2, "idle");
+    lua_pushnumber(L, stats->busy / 1000.0);
+    lua_setfield(L, -2, "busy");
+    director_push_histogram(L, &stats->wait);
+    lua_setfield(L, -2, "wait");
+    director_push_histogram(L, &stats->handler);
+    lua_setfield(L, -2, "handler");
+}
+
+/*
+ * Director.stats()
+ *
+ * Returns a table of what every Worker of the default pool has done, in or
+ * out of it, what the Workers of each named pool have done, and the totals.
+ * Times are in microseconds except the uptime, which is in seconds.
+ *
+ * {
+ *   uptime = 12.5, pool = 4,
+ *   workers = { {processed = 9001, failed = 0, depth = 3, idle = ...,
+ *                busy = ..., wait = {count, p50, p90, p99, max},
+ *                handler = {...}}, ... },
+ *   pools = { render = { {processed = 42, ...} }, ... },
+ *   total = {...}, overflow = {...}
+ * }
+ */
+static int
+lua_director_stats (lua_State *L)
+{
+    const int started = __atomic_load_n(&global_director->worker_started, 
+            __ATOMIC_ACQUIRE);
+    const int pools = __atomic_load_n(&global_director->pool_count, 
+            __ATOMIC_ACQUIRE);
+    struct timeval *start = &global_director->start;
+    struct timeval now;
+    DirectorPool *pool = NULL;
+    Stats stats;
+    int i, j;
+
+    /* any thread may ask, so not the Director's own `now' */
+    gettimeofday(&now, NULL);
+
+    lua_newtable(L);
+    lua_pushnumber(L, (now.tv_sec - start->tv_sec) 
+            + (now.tv_usec - start->tv_usec) / 1000000.0);
+    lua_setfield(L, -2, "uptime");
+    lua_pushinteger(L, director_worker_count());
+    lua_setfield(L, -2, "pool");
+
+    lua_createtable(L, started, 0);
+    for (i = 0; i < started; i++) {
+        worker_stats(global_director->workers[i], &stats);
+        director_push_stats(L, &stats);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "workers");
+
+    lua_createtable(L, 0, pools - 1);
+    for (i = 1; i < pools; i++) {
+        pool = &global_director->pools[i];
+        lua_createtable(L, pool->count, 0);
+
+        for (j = 0; j < pool->count; j++) {
+            worker_stats(global_director->workers[pool->first + j], &stats);
+            director_push_stats(L, &stats);
+            lua_rawseti(L, -2, j + 1);
+        }
+
+        lua_setfield(L, -2, pool->name);
+    }
+    lua_setfield(L, -2, "pools");
+
+    director_stats(0, &stats);
+    director_push_stats(L, &stats);
+    lua_setfield(L, -2, "total");
+
+    lua_director_overflow(L);
+    lua_setfield(L, -2, "overflow");
+
+    return 1;
+}
+
+static const luaL_Reg director_functions[] = {
+    {"overflow", lua_director_overflow},
+    {"timed",    lua_director_timed},
+    {"after",    director_take_delayed_action},
+    {"batch",    lua_director_batch},
+    {"pump",     lua_director_pump},
+    {"wait_idle", lua_director_wait_idle},
+    {"flush",    lua_director_wait_idle},
+    {"begin_steps", lua_director_begin_steps},
+    {"step",     lua_director_step},
+    {"run_steps", lua_director_run_steps},
+    {"end_steps", lua_director_end_steps},
+    {"cancel",   lua_director_cancel},
+    {"pin",      lua_director_pin},
+    {"workers",  lua_director_workers},
+    {"pool",     lua_director_pool},
+    {"stats",    lua_director_stats},
+    {"priority", director_take_priority_action},
+    { NULL, NULL }
+};
+
+static const luaL_Reg director_metamethods[] = {
+    {"__call",   lua_director_call},
+    { NULL, NULL }
+};
+
+int
+luaopen_Dialogue_Director (lua_State *L)
+{
+    luaL_newlib(L, director_functions);
+
+    luaL_newmetatable(L, DIRECTOR_META);
+    luaL_setfuncs(L, director_metamethods, 0);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+/*
+ * Set the Director's table inside the Lua state as "Director".
+ */
+void
+director_set (lua_State *L)
+{
+    luaL_requiref(L, "Director", luaopen_Dialogue_Director, 1);
+    lua_pop(L, 1);
+}
+
+/*
+ * Copy the counts of what the overflow policies have done into `overflow'.
+ */
+void
+director_overflow (DirectorOverflow *overflow)
+{
+    DirectorOverflow *counts = &global_director->overflow;
+
+    overflow->blocked = __atomic_load_n(&counts->blocked, __ATOMIC_RELAXED);
+    overflow->rejected = __atomic_load_n(&counts->rejected, __ATOMIC_RELAXED);
+    overflow->dropped_newest = __atomic_load_n(&counts->dropped_newest, 
+            __ATOMIC_RELAXED);
+    overflow->dropped_oldest = __atomic_load_n(&counts->dropped_oldest, 
+            __ATOMIC_RELAXED);
+}
+
+/*
+ * Copy the Stats of the Worker with the thread id into `stats', or the totals
+ * of every Worker if thread is 0. Returns 0 if successful, 1 if there is no
+ * Worker with the thread id.
+ */
+int
+director_stats (const int thread, Stats *stats)
+{
+    Worker *worker = NULL;
+    Stats each;
+    int i;
+
+    if (thread > 0) {
+        worker = director_started_worker(thread - 1);
+
+        if (!worker)
+            return 1;
+
+        worker_stats(worker, stats);
+        return 0;
+    }
+
+    if (thread < 0)
+        return 1;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (i = 0; i < global_director->worker_max; i++) {
+        worker = director_started_worker(i);
+
+        if (worker) {
+            worker_stats(worker, &each);
+            stats_merge(stats, &each);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Steal an Action for the Worker with thief_id from one of the other Workers
+ * of its pool. The Workers are visited in order starting after the thief so
+ * thieves don't all crowd the same victim. Only Actions of Actors without a
+ * thread requirement can be stolen, mostly the run tokens of whole Actors.
+ *
+ * Workers taken out of the default pool don't steal, but are stolen from so
+ * they drain faster.
+ *
+ * Returns NULL if there was nothing to steal.
+ */
+Action *
+director_steal_action (const int thief_id)
+{
+    DirectorPool *pool = director_worker_pool(thief_id);
+    Worker *victim = NULL;
+    Action *action = NULL;
+    int i, count;
+
+    if (!pool || thief_id >= pool->first + director_pool_count(pool))
+        return NULL;
+
+    if (pool == global_director->pools)
+        count = __atomic_load_n(&global_director->worker_started, 
+                __ATOMIC_ACQUIRE);
+    else
+        count = pool->count;
+
+    for (i = 1; i < count && !action; i++) {
+        victim = global_director->workers[pool->first 
+            + (thief_id - pool->first + i) % count];
+
+        /* Workers can steal before the Director has started all of them */
+        if (victim)
+            action = worker_steal_action(victim);
+    }
+
+    return action;
+}
+
+/*
+ * Stop the Worker which was just taken out of the pool. It handles its high
+ * priority and pinned Actions, and the Actors it is running, first. The
+ * shared Actions and run tokens which reached it since go to a Worker of the
+ * pool, what was pinned to it is rejected. A Worker doesn't stop itself, it
+ * only stops getting new Actions.
+ */
+static void
+director_retire (Worker *worker)
+{
+    Action *action = NULL, *next = NULL;
+
+    if (worker == worker_self())
+        return;
+
+    worker_stop(worker);
+    action = worker_hand_over(worker, director_choose(global_director->pools));
+
+    for (; action; action = next) {
+        next = action->next;
+
+        if (action_is_empty(action)) {
+            action_destroy(action);
+            continue;
+        }
+
+        director_is_stale(action);
+        director_finish_action(action->actor);
+        director_reject_removed(NULL, action, worker_id(worker) + 1);
+    }
+}
+
+/*
+ * Grow or shrink the pool of Workers to `count' (at least 1, at most
+ * WORKER_MAX less the Workers of named pools). Returns the size of the pool
+ * afterwards, which is smaller than asked if a new Worker couldn't be
+ * started.
+ *
+ * Growing restarts the Workers which were taken out of the pool first and
+ * only then starts new threads. Shrinking takes the Workers with the
+ * highest indices out of the pool and stops them, see `director_retire'.
+ * Actors routed to one move to a Worker in the pool. New Actions of Actors
+ * whose thread requirement is a removed Worker are rejected.
+ */
+int
+director_resize (int count)
+{
+    int i, removed;
+
+    if (count < 1)
+        count = 1;
+
+    pthread_mutex_lock(&resize_mutex);
+
+    if (count > global_director->pool_floor)
+        count = global_director->pool_floor;
+
+    removed = director_worker_count();
+
+    for (i = removed; i < count && i < global_director->worker_started; i++)
+        if (worker_restart(global_director->workers[i]) != 0) {
+            count = i;
+            break;
+        }
+
+    for (i = global_director->worker_started; i < count; i++) {
+        global_director->workers[i] = worker_start(i, 0);
+
+        if (!global_director->workers[i]) {
+            count = i;
+            break;
+        }
+
+        __atomic_store_n(&global_director->worker_started, i + 1, 
+                __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&global_director->worker_count, count, __ATOMIC_RELEASE);
+
+    for (i = removed - 1; i >= count; i--)
+        director_retire(global_director->workers[i]);
+
+    pthread_mutex_unlock(&resize_mutex);
+
+    return count;
+}
+
+/*
+ * Returns the id of the pool with the name, -1 if there is none. The default
+ * pool is "default" and its id is 0.
+ */
+int
+director_pool_id (const char *name)
+{
+    const int count = __atomic_load_n(&global_director->pool_count, 
+            __ATOMIC_ACQUIRE);
+    int i;
+
+    for (i = 0; i < count; i++)
+        if (strcmp(global_director->pools[i].name, name) == 0)
+            return i;
+
+    return -1;
+}
+
+/*
+ * Start a named pool of `size' Workers whose threads run at the `nice' value
+ * and which choose Workers by the `dispatch' mode. The Workers are taken from
+ * the end of the Director's, so the default pool can't grow into them.
+ *
+ * Returns 0 if successful, 1 if there's already a pool with the name, there
+ * are too many pools or WORKER_MAX leaves no room for the Workers, and 2 if a
+ * Worker couldn't be started.
+ */
+int
+director_add_pool (const char *name, const int size, const int nice,
+        const int dispatch)
+{
+    DirectorPool *pool = NULL;
+    int i, first, ret = 1;
+
+    pthread_mutex_lock(&resize_mutex);
+
+    first = global_director->pool_floor - size;
+
+    if (size < 1 || first < global_director->worker_started
+            || strlen(name) >= DIRECTOR_POOL_NAME
+            || global_director->pool_count == DIRECTOR_POOL_MAX
+            || director_pool_id(name) != -1)
+        goto exit;
+
+    /* 
+     * Workers past the floor don't steal until their pool is added, and the
+     * default pool doesn't grow into them.
+     */
+    __atomic_store_n(&global_director->pool_floor, first, __ATOMIC_RELEASE);
+
+    for (i = first; i < first + size; i++) {
+        global_director->workers[i] = worker_start(i, nice);
+
+        if (!global_director->workers[i])
+            goto stop_workers;
+    }
+
+    pool = &global_director->pools[global_director->pool_count];
+    strcpy(pool->name, name);
+    pool->first = first;
+    pool->count = size;
+    pool->dispatch = dispatch;
+    pool->nice = nice;
+
+    __atomic_store_n(&global_director->pool_count, 
+            global_director->pool_count + 1, __ATOMIC_RELEASE);
+
+    ret = 0;
+    goto exit;
+
+stop_workers:
+    ret = 2;
+
+    for (i = first; i < first + size && global_director->workers[i]; i++) {
+        worker_stop(global_director->workers[i]);
+        worker_cleanup(global_director->workers[i]);
+        global_director->workers[i] = NULL;
+    }
+
+    __atomic_store_n(&global_director->pool_floor, first + size, 
+            __ATOMIC_RELEASE);
+exit:
+    pthread_mutex_unlock(&resize_mutex);
+    return ret;
+}
+
+/*
+ * Place the newly created Actor into the pool with the id. Only the Workers
+ * of that pool handle the Actor's Actions from then on, unless an Action has
+ * a thread requirement.
+ */
+void
+director_place_actor (const int actor, const int pool)
+{
+    DirectorPool *placed = &global_director->pools[pool];
+
+    if (actor < 0 || actor >= global_director->actor_count)
+        return;
+
+    __atomic_store_n(&global_director->actor_pool[actor], pool, 
+            __ATOMIC_RELAXED);
+    global_director->deficit[actor] = 0;
+    memset(&global_director->coalesce[actor], 0, sizeof(DirectorCoalesce));
+
+    if (pool > 0)
+        global_director->affinity[actor] = placed->first 
+            + actor % placed->count;
+    else if (global_director->affinity[actor] >= director_worker_count())
+        global_director->affinity[actor] = actor % director_worker_count();
+}
+
+/*
+ * This function blocks and becomes a Worker thread using the first Worker in
+ * the Director's worker list. This function should only be called when
+ * `has_main` passed to `director_create` was true.
+ */
+void
+director_process_work ()
+{
+    worker_thread(global_director->workers[0]);
+}
+
+/*
+ * Handle the Actions of the main thread's Worker on the calling thread, for
+ * up to `max_ms' milliseconds or `max_actions' Actions (0 for no limit), and
+ * return once nothing is queued for it. This runs the Worker from a host's
+ * own loop, a frame at a time, instead of `director_process_work'.
+ *
+ * Returns the number of Actions taken, or -1 if there is no main thread
+ * Worker (see `director_create'), it is already being run, or the caller is
+ * another Worker.
+ */
+int
+director_pump (const int max_ms, const int max_actions)
+{
+    Worker *first = global_director->workers[0];
+    Worker *self = worker_self();
+
+    if (!global_director->has_main || (self && self != first))
+        return -1;
+
+    /* the pumper is set before the flag, which other threads read first */
+    if (!__atomic_load_n(&global_director->is_pumped, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&global_director->pumper, pthread_self(), 
+                __ATOMIC_RELEASE);
+        __atomic_store_n(&global_director->is_pumped, 1, __ATOMIC_RELEASE);
+    }
+
+    return worker_pump(first, max_ms, max_actions);
+}
+
+/*
+ * Returns 1 (true) if the calling thread is the one which pumps the main
+ * thread's Worker, so nothing else will handle its Actions.
+ */
+static inline int
+director_is_pumper ()
+{
+    return __atomic_load_n(&global_director->is_pumped, __ATOMIC_ACQUIRE) 
+        && !worker_self() && pthread_equal(__atomic_load_n(
+                    &global_director->pumper, __ATOMIC_ACQUIRE), 
+                pthread_self());
+}
+
+/* Do the callback (an Action-level feature) in the Worker's Lua stack.
+ * callback_id is the index of the function in the callback table in the
+ * Worker's Lua stack. The callback is given the `args' values on top of the
+ * Worker's stack, which are popped. Only the Worker's own thread may call
+ * this.
+ * Any errors are printed to the console. Returns 0 if successful, 1 if not.
+ */
+int
+director_callback (int worker_id, int callback_id, int args)
+{
+    lua_State *W = NULL;
+
+    if (!director_started_worker(worker_id - 1)) {
+        console_log("Callback for unknown Worker `%d'\n", worker_id);
+        return 1;
+    }
+
+    W = worker_state(global_director->workers[worker_id - 1]);
+
+    if (company_do_callback(W, callback_id, args) != 0) {
+        console_log("Callback failed: %s\n", lua_tostring(W, -1));
+        lua_pop(W, 1);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Wait until no Actions are queued, waiting on the Timer (see
+ * `director_take_delayed_action') or being handled, or until `deadline'
+ * milliseconds have passed, where a negative deadline is none. A handler's
+ * Actions are counted before it finishes, so a cascade of messages has
+ * settled once this returns 0. Returns 1 if the deadline passed first.
+ *
+ * The calling thread's own batch is delivered first. A Worker must not call
+ * this, it would wait on itself. The thread which pumps the main thread's
+ * Worker keeps pumping it while it waits.
+ */
+int
+director_wait_idle (const int deadline)
+{
+    const uint64_t end = stats_now() + (uint64_t) deadline * 1000000;
+    struct timespec pause = { 0, 1000000 };
+    const int is_pumper = director_is_pumper();
+
+    director_flush();
+
+    while (__atomic_load_n(&global_director->in_flight, __ATOMIC_ACQUIRE)) {
+        if (deadline >= 0 && stats_now() >= end)
+            return 1;
+
+        if (is_pumper)
+            director_pump(1, 0);
+
+        nanosleep(&pause, NULL);
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the Worker which runs the Actor in every superstep: one of its
+ * pool's, by its id.
+ */
+static inline Worker *
+director_step_worker (const int actor)
+{
+    DirectorPool *pool = director_actor_pool(actor);
+
+    return global_director->workers[pool->first 
+        + actor % director_pool_count(pool)];
+}
+
+/*
+ * Move the messages kept for the next superstep into the inboxes of their
+ * Actors: those the other threads sent first, then each Worker's in the
+ * order of their ids, each in the order it was sent. Only then is every
+ * Actor with messages scheduled, in the order of their ids, on the Worker
+ * of `director_step_worker'. Returns how many messages were moved.
+ *
+ * The caller holds the step_mutex.
+ */
+static int
+director_deliver_step ()
+{
+    Action *action = NULL;
+    int i, actor, moved = 0;
+
+    for (i = 0; i <= global_director->worker_max; i++) {
+        while ((action = mailbox_pop(global_director->steps[i]))) {
+            actor = action->actor;
+
+            __atomic_add_fetch(&global_director->pending[actor], 1, 
+                    __ATOMIC_ACQ_REL);
+            __atomic_add_fetch(&global_director->in_flight, 1, 
+                    __ATOMIC_ACQ_REL);
+
+            if (action->coalesce > -1)
+                __atomic_add_fetch(&global_director->coalesce[actor].pending[
+                        action->coalesce], 1, __ATOMIC_ACQ_REL);
+
+            mailbox_push(global_director->inboxes[actor], action);
+            moved++;
+        }
+    }
+
+    for (actor = 0; actor < global_director->actor_count && moved; actor++)
+        if (mailbox_count(global_director->inboxes[actor]) > 0)
+            director_schedule(actor, director_step_worker(actor), 1);
+
+    return moved;
+}
+
+/*
+ * Start running supersteps, see `director_step'. The messages sent from now
+ * on are kept for the first step.
+ */
+void
+director_begin_steps ()
+{
+    __atomic_store_n(&global_director->is_stepping, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Run one superstep, starting to run them if the Director wasn't already.
+ *
+ * Once running supersteps, a normal message for an Actor (one without a
+ * thread requirement or a high priority) isn't handled when it is sent but
+ * kept for the next step. Each step first waits for whatever is still under
+ * way, then hands every Actor the messages sent to it since the last step,
+ * and waits again until they have all been handled (see
+ * `director_wait_idle'). So in step N every Actor handles what was sent to
+ * it in step N-1 and what it sends is for step N+1.
+ *
+ * Each Actor runs on one Worker of its pool chosen by its id, which nothing
+ * steals it from, and it runs alone there until its messages are done. As
+ * long as the Actors do the same with the same messages, every step hands
+ * each of them its messages in the same order. Other Actions are handled as
+ * usual, when they arrive.
+ *
+ * Returns the number of messages handed to the Actors, 0 if nothing was sent
+ * since the last step.
+ */
+int
+director_step ()
+{
+    int moved;
+
+    pthread_mutex_lock(&step_mutex);
+    director_begin_steps();
+
+    director_wait_idle(-1);
+    moved = director_deliver_step();
+    director_wait_idle(-1);
+
+    pthread_mutex_unlock(&step_mutex);
+    return moved;
+}
+
+/*
+ * Stop running supersteps, once whatever is under way has been handled or
+ * `deadline' milliseconds have passed, where a negative deadline is none.
+ * Then the messages kept for the next step are handed to their Actors right
+ * away, and new ones are handled when they're sent, as usual. Returns the
+ * number of messages which were kept.
+ */
+int
+director_end_steps (const int deadline)
+{
+    int moved;
+
+    pthread_mutex_lock(&step_mutex);
+    __atomic_store_n(&global_director->is_stepping, 0, __ATOMIC_RELEASE);
+
+    /* a handler which saw the steps running keeps its messages for one */
+    director_wait_idle(deadline);
+    moved = director_deliver_step();
+    pthread_mutex_unlock(&step_mutex);
+
+    return moved;
+}
+
+/*
+ * Shut down gracefully within a bounded time:
+ *
+ *  1. New Actions are refused unless a Worker sends them, so conversations
+ *     already under way can finish but nothing new starts, timed Actions
+ *     included. Those still waiting on the Timer are refused right away.
+ *  2. Everything queued is handled in order, for up to `deadline' ms. That
+ *     includes messages kept for the next superstep, see `director_step'.
+ *  3. Only lifecycle Actions are taken now. Every Actor is sent `unload',
+ *     which runs on the Worker that owns the Actor, all of them in parallel,
+ *     for up to another `deadline' ms.
+ *  4. Everything is refused and the Workers are stopped and closed. Actions
+ *     still queued are dropped.
+ *
+ * The report counts what was refused and dropped. A handler which never
+ * returns still holds up its Worker's stop.
+ */
+void
+director_shutdown (lua_State *L, const int deadline, DirectorShutdown *report)
+{
+    const uint64_t start = stats_now();
+
+    report->is_late = 0;
+
+    __atomic_store_n(&global_director->intake, INTAKE_WORKERS, 
+            __ATOMIC_RELEASE);
+
+    /* they would be refused when they're sent, there's no use waiting */
+    __atomic_add_fetch(&global_director->refused, 
+            timer_clear(global_director->timer), __ATOMIC_RELAXED);
+
+    /* messages kept for a superstep are drained with everything else */
+    director_end_steps(0);
+
+    report->is_late |= director_wait_idle(deadline);
+
+    __atomic_store_n(&global_director->intake, INTAKE_LIFECYCLE, 
+            __ATOMIC_RELEASE);
+    company_cleanup(L);
+    report->is_late |= director_wait_idle(deadline);
+
+    __atomic_store_n(&global_director->intake, INTAKE_CLOSED, 
+            __ATOMIC_RELEASE);
+    report->refused = __atomic_load_n(&global_director->refused, 
+            __ATOMIC_ACQUIRE);
+    report->dropped = director_close();
+    report->elapsed = (long) ((stats_now() - start) / 1000000);
+}
+
+/*
+ * Close the Director and all of the Workers. Returns the number of Actions
+ * which were still queued and were thrown away.
+ */
+int
+director_close ()
+{
+    int i, dropped;
+
+    /* no more timed Actions once the Workers start stopping */
+    if (global_director->timer)
+        timer_stop(global_director->timer);
+
+    /* stop everything first, in or out of the pools */
+    for (i = 0; i < global_director->worker_max; i++)
+        if (global_director->workers[i])
+            worker_stop(global_director->workers[i]);
+
+    dropped = global_director->in_flight + director_destroy_steps();
+
+    /* then cleanup, it avoids a lot of problems */
+    for (i = 0; i < global_director->worker_max; i++)
+        if (global_director->workers[i])
+            worker_cleanup(global_director->workers[i]);
+
+    director_destroy_inboxes();
+    action_pool_clear();
+    free(global_director->actor_pool);
+    free(global_director->pending);
+    free(global_director->affinity);
+    free(global_director->workers);
+    free(global_director);
+
+    return dropped;
 }
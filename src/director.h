@@ -2,6 +2,29 @@
 #define DIALOGUE_DIRECTOR
 
 #include "dialogue.h"
+#include "action.h"
+#include "stats.h"
+
+/*
+ * What the overflow policies have done with Actions which arrived when a
+ * Worker's mailbox (or an Actor's queue) was full.
+ */
+typedef struct DirectorOverflow {
+    int blocked; /* times a producer had to wait for room */
+    int rejected; /* Actions refused with an error to the producer */
+    int dropped_newest; /* Actions thrown away on arrival */
+    int dropped_oldest; /* queued Actions thrown away to make room */
+} DirectorOverflow;
+
+/*
+ * What a shutdown did, see `director_shutdown'.
+ */
+typedef struct DirectorShutdown {
+    int refused; /* new Actions refused while shutting down */
+    int dropped; /* queued Actions thrown away when the Workers stopped */
+    int is_late; /* the drain or the unloads ran past the deadline */
+    long elapsed; /* milliseconds the whole shutdown took */
+} DirectorShutdown;
 
 /*
  * Load the Director and all of the Workers.
@@ -10,7 +33,7 @@ int
 director_create (const int has_main, const int num_workers);
 
 /*
- * Set the `director_action` function inside the Lua state as "Director".
+ * Set the Director's table inside the Lua state as "Director".
  */
 void
 director_set (lua_State *L);
@@ -20,19 +43,273 @@ director_set (lua_State *L);
  * Worker and does no validation. The validation occurs at the Worker level,
  * where other errors might pop up from bad inputs.
  * 
- * From a random starting point (generated by the seed) 0..worker-max, we loop
- * through the workers until one isn't busy. Send the action to the open
- * worker. 
+ * The Action is serialized once here and pushed into the inbox of the Actor
+ * it is for. The Actor itself (its run token) is put on a Worker's run queue
+ * if it isn't on one already, and only that Worker handles the Actor's
+ * Actions until it releases it. So an Actor's Actions are handled in order
+ * and Workers never wait on each other for the same Actor. Mailboxes never
+ * block, so there is no need to look for one that isn't busy. The Worker is
+ * chosen by queue depth (DISPATCH_TWO_CHOICES or DISPATCH_LEAST) or at
+ * random (DISPATCH_RANDOM). Idle Workers steal runnable Actors from busy
+ * ones.
+ *
+ * In affinity mode (DISPATCH_AFFINITY) an Actor always runs on the same
+ * Worker instead, which only moves the Actor when it falls behind. Those
+ * Actors are not stolen.
+ *
+ * Actions which aren't for a known Actor, or have a thread requirement, skip
+ * the inboxes and go straight to a Worker's mailbox. High priority Actions
+ * for an Actor go through its inbox but skip ahead of its normal ones.
  *
  * An optional thread_id can be passed which tells the director which Worker
- * process to target. If the thread_id == 0, the Director handles the message 
+ * process to target. If the thread_id == 1, the Director handles the message 
  * itself on the main thread.
  *
- * Returns 0 if successful.
+ * When the Worker's mailbox or the Actor's queue is at capacity, the
+ * overflow policy decides whether the caller blocks, gets an error, or an
+ * Action is dropped. See `director_overflow'.
+ *
+ * Calls of the lifecycle methods `load' and `unload' have a high priority.
+ * They skip ahead of every normal Action queued for the Worker and aren't
+ * held back by the overflow policy.
+ *
+ * An Action with a `ttl' field is only worth handling for that many
+ * milliseconds after it is sent. Workers drop it unhandled once that has
+ * passed, and an Actor's queued Actions are handled earliest deadline first.
+ * That can put it ahead of Actions its sender sent earlier, the order they
+ * were sent in only holds among those with the same deadline, or none.
+ *
+ * Errors through L if there isn't enough memory for the Action or if the
+ * Action was rejected by the overflow policy.
  */
 int
 director_take_action (lua_State *L);
 
+/*
+ * Director.priority(action, priority [, thread_id])
+ *
+ * Take the Action like `director_take_action' but with the given priority,
+ * either "high" or "normal", rather than one based on its method.
+ */
+int
+director_take_priority_action (lua_State *L);
+
+/*
+ * Take an Action calling the method (see `enum ActionMethod') of the Actor,
+ * which is the first of the `count' values from index of L, the rest being
+ * its arguments. It is taken like `director_take_action' takes
+ * {actor, method, arg1, ..., argN}, but no table is built for it. The
+ * priority is ACTION_NORMAL, ACTION_HIGH or -1 for one based on the method.
+ * Nothing is popped.
+ *
+ * Errors through L like `director_take_action'.
+ */
+void
+director_take_call (lua_State *L, const int method, const int index, 
+        const int count, const int priority, const int thread);
+
+/*
+ * Cancel the Action waiting on the Timer with the handle, see
+ * `director_take_delayed_action'. Returns 1 if it was cancelled, 0 if it had
+ * already been sent or cancelled (or the handle is -1).
+ */
+int
+director_cancel (const int handle);
+
+/*
+ * Director.after(delay, action [, thread])
+ *
+ * Take the Action once after `delay' milliseconds. Returns the handle for
+ * `Director.cancel'. The Action is in flight while it waits, so
+ * `Director.wait_idle' waits for it too.
+ *
+ * Once shutting down has begun, the Timer's Actions would be refused when
+ * they're sent, so the Action is refused now and the handle is -1.
+ */
+int
+director_take_delayed_action (lua_State *L);
+
+/*
+ * Take an Action which was already serialized, like one sent by the Timer.
+ * The thread requirement is the same as `director_take_action'. The Action is
+ * dropped if the overflow policy rejects it.
+ */
+void
+director_give_action (Action *action, const int thread);
+
+/*
+ * Returns the id of the Actor if the Action is its run token, otherwise -1.
+ */
+int
+director_run_token (Action *action);
+
+/*
+ * Pop the Action of the Actor with the earliest deadline, or the oldest if
+ * none have one. Everything in the Actor's inbox is taken out and held in
+ * deadline order first. Only the Worker which popped the Actor's run token
+ * may call this, until it releases the Actor. Returns NULL if the Actor has
+ * nothing queued (or a push into its inbox hasn't finished).
+ */
+Action *
+director_inbox_action (const int actor);
+
+/*
+ * Start the turn of the Actor whose run token the calling Worker popped, 
+ * deficit round robin style. The Actor is given the quantum of handler time,
+ * on top of whatever it owes from turns which ran over it, but it can't save
+ * up more than one quantum. Returns 1 if it has time left to run now, 0 if it
+ * must wait for its next turn to pay off the rest of what it owes.
+ *
+ * Without a time quantum (ACTOR_TIME_QUANTUM of 0) every turn may run, and
+ * so does every turn of a superstep, which would otherwise depend on timing.
+ */
+int
+director_begin_turn (const int actor);
+
+/*
+ * Charge the Actor the Worker is running for `elapsed' nanoseconds of
+ * handler time. Returns 1 if the Actor has time left in its turn, 0 if its
+ * turn is over.
+ */
+int
+director_charge_actor (const int actor, const uint64_t elapsed);
+
+/*
+ * The calling Worker is done running the Actor for now. If the Actor has more
+ * Actions, its run token goes to the back of a run queue, otherwise it is
+ * unscheduled until its next Action arrives. During a superstep the token
+ * stays with the Worker, so nothing is stolen.
+ */
+void
+director_release_actor (const int actor);
+
+/*
+ * A Worker drained the Action from a mailbox. Returns 1 (true) if it is a
+ * message the Actor coalesces and a newer copy of it is queued behind it, so
+ * it is stale and can be skipped. Must be called once for each drained
+ * Action, skipped or not.
+ */
+int
+director_is_stale (Action *action);
+
+/*
+ * Let the Actor coalesce the message with the name, or every message if it
+ * is NULL. An Actor can coalesce up to DIRECTOR_COALESCE_SLOTS different
+ * messages, any others are always handled.
+ */
+void
+director_coalesce (const int actor, const char *message);
+
+/*
+ * Stop the Actor from coalescing any messages, e.g. before its Scripts are
+ * reloaded. Copies already queued are still counted.
+ */
+void
+director_coalesce_clear (const int actor);
+
+/*
+ * Hold back the Actions the calling thread sends until the matching
+ * `director_batch_end'. Batches nest, only the outermost one delivers.
+ */
+void
+director_batch_begin ();
+
+/*
+ * End the calling thread's batch. If it is the outermost, every Action sent
+ * during it is delivered: the Actions for one Actor's inbox, or one of a
+ * Worker's mailboxes, are pushed together and the Actor is scheduled, or the
+ * Worker woken, only once.
+ *
+ * A Worker's capacity is checked as each Action is sent, so the Actions
+ * still in an outbox can go past it by a batch's worth.
+ */
+void
+director_batch_end ();
+
+/*
+ * A Worker has finished handling an Action for the Actor with the given id.
+ */
+void
+director_finish_action (const int actor);
+
+/*
+ * Throw away the Action the drop-oldest policy picked to make room in a full
+ * queue. Only the queue's consumer may call this, the Action was counted as
+ * dispatched so it is finished here.
+ */
+void
+director_drop_oldest (Action *action);
+
+/*
+ * Copy the counts of what the overflow policies have done into `overflow'.
+ */
+void
+director_overflow (DirectorOverflow *overflow);
+
+/*
+ * Copy the Stats of the Worker with the thread id into `stats', or the totals
+ * of every Worker if thread is 0. Returns 0 if successful, 1 if there is no
+ * Worker with the thread id.
+ */
+int
+director_stats (const int thread, Stats *stats);
+
+/*
+ * Steal an Action for the Worker with thief_id from one of the other Workers
+ * of its pool. The Workers are visited in order starting after the thief so
+ * thieves don't all crowd the same victim. Only Actions of Actors without a
+ * thread requirement can be stolen, mostly the run tokens of whole Actors.
+ *
+ * Returns NULL if there was nothing to steal.
+ */
+Action *
+director_steal_action (const int thief_id);
+
+/*
+ * Grow or shrink the pool of Workers to `count' (at least 1, at most
+ * WORKER_MAX less the Workers of named pools). Returns the size of the pool
+ * afterwards, which is smaller than asked if a new Worker couldn't be
+ * started.
+ *
+ * Growing puts Workers which were taken out of the pool back first and only
+ * then starts new threads. Shrinking takes the Workers with the highest
+ * indices out of the pool, but they aren't stopped. Each one keeps handling
+ * the Actions it already has (and lets the others steal its shared ones)
+ * before it parks, so nothing queued is lost. Actors routed to one move to a
+ * Worker in the pool once their queued Actions are done. New Actions of
+ * Actors whose thread requirement is a removed Worker are rejected.
+ */
+int
+director_resize (int count);
+
+/*
+ * Returns the id of the pool with the name, -1 if there is none. The default
+ * pool is "default" and its id is 0.
+ */
+int
+director_pool_id (const char *name);
+
+/*
+ * Start a named pool of `size' Workers whose threads run at the `nice' value
+ * and which choose Workers by the `dispatch' mode. The Workers are taken from
+ * the end of the Director's, so the default pool can't grow into them.
+ *
+ * Returns 0 if successful, 1 if there's already a pool with the name, there
+ * are too many pools or WORKER_MAX leaves no room for the Workers, and 2 if a
+ * Worker couldn't be started.
+ */
+int
+director_add_pool (const char *name, const int size, const int nice,
+        const int dispatch);
+
+/*
+ * Place the newly created Actor into the pool with the id. Only the Workers
+ * of that pool handle the Actor's Actions from then on, unless an Action has
+ * a thread requirement.
+ */
+void
+director_place_actor (const int actor, const int pool);
+
 /*
  * This function blocks and becomes a Worker thread using the first Worker in
  * the Director's worker list. This function should only be called when
@@ -42,28 +319,108 @@ void
 director_process_work ();
 
 /*
- * TODO:
- *  Director.timed(30, 1000, { action })
- *  Do an action 30 times per second (1000 miliseconds)
+ * Handle the Actions of the main thread's Worker on the calling thread, for
+ * up to `max_ms' milliseconds or `max_actions' Actions (0 for no limit), and
+ * return once nothing is queued for it. This runs the Worker from a host's
+ * own loop, a frame at a time, instead of `director_process_work'.
  *
- *  Spawn a thread which loops over given actions and send them with the
- *  chosen regularity. The thread can be spawned by the Director.timed function
- *  which spawns the thread the first time its called.
+ * Returns the number of Actions taken, or -1 if there is no main thread
+ * Worker (see `director_create'), it is already being run, or the caller is
+ * another Worker.
  */
+int
+director_pump (const int max_ms, const int max_actions);
 
 /*
  * Do the callback (an Action-level feature) in the Worker's Lua stack.
  * callback_id is the index of the function in the callback table in the
- * Worker's Lua stack.
- * Any errors are printed to the console.
+ * Worker's Lua stack. The callback is given the `args' values on top of the
+ * Worker's stack, which are popped. Only the Worker's own thread may call
+ * this.
+ * Any errors are printed to the console. Returns 0 if successful, 1 if not.
  */
 int
-director_callback (int worker_id, int callback_id);
+director_callback (int worker_id, int callback_id, int args);
 
 /*
- * Close the Director and all of the Workers.
+ * Wait until no Actions are queued, waiting on the Timer (see
+ * `director_take_delayed_action') or being handled, or until `deadline'
+ * milliseconds have passed, where a negative deadline is none. A handler's
+ * Actions are counted before it finishes, so a cascade of messages has
+ * settled once this returns 0. Returns 1 if the deadline passed first.
+ *
+ * The calling thread's own batch is delivered first. A Worker must not call
+ * this, it would wait on itself. The thread which pumps the main thread's
+ * Worker keeps pumping it while it waits.
+ */
+int
+director_wait_idle (const int deadline);
+
+/*
+ * Start running supersteps, see `director_step'. The messages sent from now
+ * on are kept for the first step.
  */
 void
+director_begin_steps ();
+
+/*
+ * Run one superstep, starting to run them if the Director wasn't already.
+ *
+ * Once running supersteps, a normal message for an Actor (one without a
+ * thread requirement or a high priority) isn't handled when it is sent but
+ * kept for the next step. Each step first waits for whatever is still under
+ * way, then hands every Actor the messages sent to it since the last step,
+ * and waits again until they have all been handled (see
+ * `director_wait_idle'). So in step N every Actor handles what was sent to
+ * it in step N-1 and what it sends is for step N+1.
+ *
+ * Each Actor runs on one Worker of its pool chosen by its id, which nothing
+ * steals it from, and it runs alone there until its messages are done. As
+ * long as the Actors do the same with the same messages, every step hands
+ * each of them its messages in the same order. Other Actions are handled as
+ * usual, when they arrive.
+ *
+ * Returns the number of messages handed to the Actors, 0 if nothing was sent
+ * since the last step.
+ */
+int
+director_step ();
+
+/*
+ * Stop running supersteps, once whatever is under way has been handled or
+ * `deadline' milliseconds have passed, where a negative deadline is none.
+ * Then the messages kept for the next step are handed to their Actors right
+ * away, and new ones are handled when they're sent, as usual. Returns the
+ * number of messages which were kept.
+ */
+int
+director_end_steps (const int deadline);
+
+/*
+ * Shut down gracefully within a bounded time:
+ *
+ *  1. New Actions are refused unless a Worker sends them, so conversations
+ *     already under way can finish but nothing new starts, timed Actions
+ *     included. Those still waiting on the Timer are refused right away.
+ *  2. Everything queued is handled in order, for up to `deadline' ms. That
+ *     includes messages kept for the next superstep, see `director_step'.
+ *  3. Only lifecycle Actions are taken now. Every Actor is sent `unload',
+ *     which runs on the Worker that owns the Actor, all of them in parallel,
+ *     for up to another `deadline' ms.
+ *  4. Everything is refused and the Workers are stopped and closed. Actions
+ *     still queued are dropped.
+ *
+ * The report counts what was refused and dropped. A handler which never
+ * returns still holds up its Worker's stop.
+ */
+void
+director_shutdown (lua_State *L, const int deadline, DirectorShutdown *report);
+
+/*
+ * Close the Director and all of the Workers. Returns the number of Actions
+ * which were still queued and were thrown away.
+ */
+int
 director_close ();
 
 #endif
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include "mailbox.h"
+
+struct Mailbox {
+    Action *head; /* most recently pushed, producers swap this */
+    Action *tail; /* oldest, only touched by the consumer */
+    Action stub;  /* keeps the queue non-empty so head & tail are never NULL */
+    int count;
+};
+
+/*
+ * Create an empty Mailbox. Returns NULL on failure.
+ */
+Mailbox *
+mailbox_create ()
+{
+    Mailbox *mailbox = malloc(sizeof(*mailbox));
+
+    if (!mailbox)
+        goto exit;
+
+    mailbox->stub.next = NULL;
+    mailbox->stub.data = NULL;
+    mailbox->head = &mailbox->stub;
+    mailbox->tail = &mailbox->stub;
+    mailbox->count = 0;
+
+exit:
+    return mailbox;
+}
+
+/*
+ * Link the Actions from first to last in, with last as the new head. The
+ * links between them must already be made.
+ */
+static inline void
+mailbox_link (Mailbox *mailbox, Action *first, Action *last)
+{
+    Action *previous;
+
+    __atomic_store_n(&last->next, NULL, __ATOMIC_RELAXED);
+    previous = __atomic_exchange_n(&mailbox->head, last, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&previous->next, first, __ATOMIC_RELEASE);
+}
+
+/*
+ * Push the Action into the Mailbox. Safe to call from any thread. The Mailbox
+ * owns the Action until it is popped.
+ */
+void
+mailbox_push (Mailbox *mailbox, Action *action)
+{
+    /* counted first so a consumer never sees a linked Action it can't count */
+    __atomic_add_fetch(&mailbox->count, 1, __ATOMIC_SEQ_CST);
+    mailbox_link(mailbox, action, action);
+}
+
+/*
+ * Push `count' Actions, linked through `next' from first to last, into the
+ * Mailbox with a single exchange. They are popped in that order and nothing
+ * pushed by another thread comes between them. Safe to call from any thread.
+ */
+void
+mailbox_push_chain (Mailbox *mailbox, Action *first, Action *last, 
+        const int count)
+{
+    __atomic_add_fetch(&mailbox->count, count, __ATOMIC_SEQ_CST);
+    mailbox_link(mailbox, first, last);
+}
+
+/*
+ * Pop the oldest Action from the Mailbox. Only the consumer may call this.
+ * Returns NULL if the Mailbox is empty or if a push hasn't finished yet.
+ */
+Action *
+mailbox_pop (Mailbox *mailbox)
+{
+    Action *tail = mailbox->tail;
+    Action *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    /* skip over the stub if it is the oldest item */
+    if (tail == &mailbox->stub) {
+        if (next == NULL)
+            return NULL;
+        mailbox->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL)
+        goto pop;
+
+    /* a producer has swapped the head but not linked it yet */
+    if (tail != __atomic_load_n(&mailbox->head, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    /* tail is the last item, put the stub behind it so it can be taken */
+    mailbox_link(mailbox, &mailbox->stub, &mailbox->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (next == NULL)
+        return NULL;
+
+pop:
+    mailbox->tail = next;
+    __atomic_sub_fetch(&mailbox->count, 1, __ATOMIC_SEQ_CST);
+    return tail;
+}
+
+/*
+ * The number of Actions pushed but not yet popped.
+ */
+int
+mailbox_count (Mailbox *mailbox)
+{
+    return __atomic_load_n(&mailbox->count, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Destroy the Mailbox and every Action still inside of it. No other thread
+ * may be using the Mailbox.
+ */
+void
+mailbox_destroy (Mailbox *mailbox)
+{
+    Action *action;
+
+    while ((action = mailbox_pop(mailbox)) != NULL)
+        action_destroy(action);
+
+    free(mailbox);
+}
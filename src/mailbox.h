@@ -0,0 +1,66 @@
+/*============================================================================/
+
+    A Mailbox is an unbounded multi-producer, single-consumer queue of
+  Actions. Any thread can push an Action without taking a lock. Only the
+  thread which owns the Mailbox (a Worker) may pop from it.
+
+  It is an intrusive queue in the style of Dmitry Vyukov's MPSC queue: a push
+  is a single atomic exchange of the head followed by linking the previous
+  head to the new Action. Because of that second step a pop can briefly see
+  the queue as empty while a push is in progress. `mailbox_count' counts a
+  pushed Action before it is linked, so a consumer that sees a count but
+  pops NULL simply has to try again. A chain of Actions already linked
+  together is pushed the same way, with one exchange for all of them.
+
+/============================================================================*/
+
+#ifndef DIALOGUE_MAILBOX
+#define DIALOGUE_MAILBOX
+
+#include "action.h"
+
+typedef struct Mailbox Mailbox;
+
+/*
+ * Create an empty Mailbox. Returns NULL on failure.
+ */
+Mailbox *
+mailbox_create ();
+
+/*
+ * Push the Action into the Mailbox. Safe to call from any thread. The Mailbox
+ * owns the Action until it is popped.
+ */
+void
+mailbox_push (Mailbox *mailbox, Action *action);
+
+/*
+ * Push `count' Actions, linked through `next' from first to last, into the
+ * Mailbox with a single exchange. They are popped in that order and nothing
+ * pushed by another thread comes between them. Safe to call from any thread.
+ */
+void
+mailbox_push_chain (Mailbox *mailbox, Action *first, Action *last, 
+        const int count);
+
+/*
+ * Pop the oldest Action from the Mailbox. Only the consumer may call this.
+ * Returns NULL if the Mailbox is empty or if a push hasn't finished yet.
+ */
+Action *
+mailbox_pop (Mailbox *mailbox);
+
+/*
+ * The number of Actions pushed but not yet popped.
+ */
+int
+mailbox_count (Mailbox *mailbox);
+
+/*
+ * Destroy the Mailbox and every Action still inside of it. No other thread
+ * may be using the Mailbox.
+ */
+void
+mailbox_destroy (Mailbox *mailbox);
+
+#endif
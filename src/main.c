@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
 #include <unistd.h>
 #include "dialogue.h"
@@ -18,14 +19,80 @@ usage (const char *program)
         "       The number of workers (threads) to spawn. Default is 4.\n\n"
         "   -s\n"
         "       Run the <STAGE-FILE> as a script, spawning no console.\n"
-        "       The program will exit when the script finishes. This disables\n"
-        "       the `-m' main thread feature.\n\n"
+        "       The program will exit when the script finishes. `-s'\n"
+        "       overrides `-m'.\n\n"
+        "   -e\n"
+        "       Like `-s -m', but the main thread does become a Worker,\n"
+        "       which only handles Actions when the script calls\n"
+        "       Director.pump(max_ms), e.g. once per frame of its own\n"
+        "       loop. Actors with a worker requirement of 1 wait until\n"
+        "       the script pumps.\n\n"
         "   -m\n"
         "       When this is set, the main thread becomes a Worker and counts\n"
         "       towards the `-w` worker count. If an actor has a worker\n"
         "       requirement of 1 (worker_id of 1 was passed to the actor's\n"
         "       constructor) then that actor's actions will be handled in the\n"
         "       main thread.\n\n"
+        "   -d <affinity|two|least|random>\n"
+        "       How Actions for actors without a worker requirement are\n"
+        "       dispatched. Each actor has its own queue and only one\n"
+        "       worker runs it at a time, so an actor handles its Actions\n"
+        "       in the order they arrived. Only a message with a time to\n"
+        "       live (actor:send_by) skips ahead of queued ones with a later\n"
+        "       deadline or none. `affinity' keeps each actor on one\n"
+        "       worker so its state stays warm in that worker's cache,\n"
+        "       moving it only when that worker falls behind. The others\n"
+        "       spread actors over all workers and let idle workers steal\n"
+        "       them from busy ones: `two' picks the less busy of two\n"
+        "       random workers, `least' picks the least busy worker, and\n"
+        "       `random' picks any worker.\n"
+        "       Default is affinity.\n\n"
+        , program);
+
+    /* in two, C99 only promises string literals of up to 4095 bytes */
+    fprintf(stderr,
+        "   -a <cpu-list>\n"
+        "       Pin each worker to one CPU of the list, like `0-7' or\n"
+        "       `0,2,4-5'. Worker N gets the N'th CPU of the list, wrapping\n"
+        "       around if there are more workers than CPUs. Each worker's\n"
+        "       memory is allocated on the NUMA node of its CPU. Workers\n"
+        "       are not pinned by default. Linux only.\n\n"
+        "   -b <number>\n"
+        "       The most Actions a worker drains from its mailbox and\n"
+        "       handles as one batch. Default is 32.\n\n"
+        "   -q <number>\n"
+        "       The most Actions of one actor a worker handles before it\n"
+        "       moves on to the next actor with Actions queued. Default\n"
+        "       is 16.\n\n"
+        "   -u <microseconds>\n"
+        "       How much handler time one actor gets per turn on a worker.\n"
+        "       Time a turn runs over is taken from the actor's next turns\n"
+        "       (deficit round robin), so actors which keep messaging\n"
+        "       themselves can't crowd out the others. 0 only limits\n"
+        "       turns by `-q'. Default is 2000.\n\n"
+        "   -t <milliseconds>\n"
+        "       How long shutting down may wait for queued Actions to be\n"
+        "       handled, and then as long again for every actor's\n"
+        "       `unload'. Whatever is left is dropped and reported.\n"
+        "       Default is 5000.\n\n"
+        "   -c <number>\n"
+        "       The most Actions queued for a worker, in its mailboxes and\n"
+        "       in the queues of the actors they were sent to it for,\n"
+        "       before it is full. Default is 0, which is unbounded.\n\n"
+        "   -p <number>\n"
+        "       The most Actions queued for a single actor before its\n"
+        "       queue is full. Default is 0, which is unbounded.\n\n"
+        "   -o <block|reject|drop-newest|drop-oldest>\n"
+        "       What happens to an Action sent to a full mailbox. `block'\n"
+        "       makes the sender wait for room (a worker sending to itself\n"
+        "       or waiting too long is rejected instead), `reject' raises\n"
+        "       an error in the sender, `drop-newest' throws the new Action\n"
+        "       away and `drop-oldest' throws away the oldest Action queued\n"
+        "       where the new one goes: the actor's queue, or the worker's\n"
+        "       mailbox for Actions of no actor or of an actor with a\n"
+        "       worker requirement. Such an actor's full queue drops the\n"
+        "       newest instead. Director.overflow() counts each of these.\n"
+        "       Default is block.\n\n"
         "   -l\n"
         "       Loading the actors manually by calling the method `load' is\n"
         "       required when this flag is set. Normally the `load' method\n"
@@ -43,8 +110,7 @@ usage (const char *program)
         "       in specific threads.\n\n"
         */
         "   -h\n"
-        "       Display this help menu and exit the program.\n\n"
-        , program);
+        "       Display this help menu and exit the program.\n\n");
     exit(1);
 }
 
@@ -64,19 +130,38 @@ handle_args (int argc, char *argv[])
     char *argv0; /* for ARGBEGIN macro, see arg.h */
     int is_script = 0;
     int is_worker = 0;
+    int is_pumped = 0;
     int workers = 0;
+    int batch = 0;
+    int quantum = 0;
+    int deadline = -1;
+    int time_quantum = -1;
+    int worker_capacity = 0;
+    int actor_capacity = 0;
+    char *dispatch = NULL;
+    char *overflow = NULL;
 
     if (argc == 1)
         usage(argv[0]);
 
     ARGBEGIN {
-        case 'w': workers = atoi(ARGF()); break;
+        case 'w': workers = atoi(EARGF(usage(argv0))); break;
+        case 'd': dispatch = EARGF(usage(argv0)); break;
+        case 'a': dialogue_set_cpus(EARGF(usage(argv0))); break;
+        case 'b': batch = atoi(EARGF(usage(argv0))); break;
+        case 'q': quantum = atoi(EARGF(usage(argv0))); break;
+        case 'u': time_quantum = atoi(EARGF(usage(argv0))); break;
+        case 't': deadline = atoi(EARGF(usage(argv0))); break;
+        case 'c': worker_capacity = atoi(EARGF(usage(argv0))); break;
+        case 'p': actor_capacity = atoi(EARGF(usage(argv0))); break;
+        case 'o': overflow = EARGF(usage(argv0)); break;
     /*
         case 'f': dialogue_option_set(ACTOR_FORCE_SYNC, 1); break;
     */
         case 'l': dialogue_option_set(ACTOR_MANUAL_LOAD, 1); break;
         case 's': is_script = 1; break;
         case 'm': is_worker = 1; break;
+        case 'e': is_pumped = 1; break;
         case 'h': usage(argv[0]); break;
         default: break;
     } ARGEND
@@ -84,15 +169,68 @@ handle_args (int argc, char *argv[])
     if (workers > 0) /* atoi errors return 0 */
         dialogue_option_set(WORKER_COUNT, workers);
 
-    if (is_script) {
-        dialogue_option_set(WORKER_IS_MAIN, 0);
-        dialogue_option_set(ACTOR_CONSOLE_WRITE, 0);
-        is_worker = 0; /* `-s` overrides `-m` */
-        path = MAIN_SCRIPT;
+    if (batch > 0)
+        dialogue_option_set(WORKER_BATCH, batch);
+
+    if (quantum > 0)
+        dialogue_option_set(ACTOR_QUANTUM, quantum);
+
+    if (deadline >= 0)
+        dialogue_option_set(SHUTDOWN_DEADLINE, deadline);
+
+    if (time_quantum >= 0)
+        dialogue_option_set(ACTOR_TIME_QUANTUM, time_quantum);
+
+    /* a mistyped mode would otherwise run with the default one */
+    if (dispatch) {
+        if (strcmp(dispatch, "affinity") == 0)
+            dialogue_option_set(DIRECTOR_DISPATCH, DISPATCH_AFFINITY);
+        else if (strcmp(dispatch, "random") == 0)
+            dialogue_option_set(DIRECTOR_DISPATCH, DISPATCH_RANDOM);
+        else if (strcmp(dispatch, "two") == 0)
+            dialogue_option_set(DIRECTOR_DISPATCH, DISPATCH_TWO_CHOICES);
+        else if (strcmp(dispatch, "least") == 0)
+            dialogue_option_set(DIRECTOR_DISPATCH, DISPATCH_LEAST);
+        else
+            usage(argv0);
     }
 
-    if (is_worker) {
+    if (worker_capacity > 0)
+        dialogue_option_set(WORKER_CAPACITY, worker_capacity);
+
+    if (actor_capacity > 0)
+        dialogue_option_set(ACTOR_CAPACITY, actor_capacity);
+
+    if (overflow) {
+        if (strcmp(overflow, "block") == 0)
+            dialogue_option_set(OVERFLOW_POLICY, OVERFLOW_BLOCK);
+        else if (strcmp(overflow, "reject") == 0)
+            dialogue_option_set(OVERFLOW_POLICY, OVERFLOW_REJECT);
+        else if (strcmp(overflow, "drop-newest") == 0)
+            dialogue_option_set(OVERFLOW_POLICY, OVERFLOW_DROP_NEWEST);
+        else if (strcmp(overflow, "drop-oldest") == 0)
+            dialogue_option_set(OVERFLOW_POLICY, OVERFLOW_DROP_OLDEST);
+        else
+            usage(argv0);
+    }
+
+    if (is_pumped) {
+        /* the script pumps the main thread's Worker itself */
+        is_script = 1;
+        is_worker = 1;
+    } else if (is_script && is_worker) {
+        fprintf(stderr, "`-s' overrides `-m', use `-e' to pump the main "
+                "thread's Worker from the script.\n");
+        is_worker = 0;
+    }
+
+    if (is_worker)
         dialogue_option_set(WORKER_IS_MAIN, 1);
+
+    if (is_script) {
+        dialogue_option_set(ACTOR_CONSOLE_WRITE, 0);
+        path = MAIN_SCRIPT;
+    } else if (is_worker) {
         path = MAIN_WORKER;
     }
 
@@ -144,6 +144,45 @@ exit:
     return ret;
 }
 
+/*
+ * Run (or continue) the handler in the coroutine on top of A with `args'
+ * values on the coroutine's stack.
+ *
+ * Returns 0 if the handler finished, leaving the coroutine on top of A with
+ * whatever the handler returned on its stack. Returns
+ * SCRIPT_YIELDED and leaves the coroutine on top of A, with whatever it
+ * yielded on its stack, if the handler yielded. Returns 1 if the handler
+ * errored, which unloads the Script and replaces the coroutine with an error
+ * string.
+ */
+static int
+script_run (Script *script, lua_State *A, const int args, const char *message)
+{
+    lua_State *C = lua_tothread(A, -1);
+    int ret = 1;
+
+    switch (lua_resume(C, A, args)) {
+    case LUA_OK:
+        ret = 0;
+        break;
+
+    case LUA_YIELD:
+        ret = SCRIPT_YIELDED;
+        break;
+
+    default:
+        lua_pushfstring(A, "Cannot send message `%s': %s", 
+                message, lua_tostring(C, -1));
+        lua_remove(A, -2); /* coroutine */
+
+        /* unload after the coroutine has been popped or it won't gc */
+        script_unload(script, A);
+        break;
+    }
+
+    return ret;
+}
+
 /*
  * Sends a Message to the object created from script_load.
  *
@@ -156,56 +195,72 @@ exit:
  * error we gain the ability to very easily add new message primitives (the
  * methods themselves) to the system.
  *
- * Returns 0 if successful, 1 if an error occurs. If an error occurs, an error
- * string is pushed onto A.
+ * The method runs in a new coroutine of A, so it may yield (see
+ * `script_resume').
+ *
+ * Returns 0 if successful, with the finished coroutine pushed onto A holding
+ * what the method returned (nothing if there was no method). Returns 1 if an
+ * error occurs, and an error string is pushed onto A. Returns SCRIPT_YIELDED
+ * if the method yielded, with the coroutine pushed onto A.
  */
 int
 script_send (Script *script, lua_State *A)
 {
     const int message_index = lua_gettop(A);
-    const int object_index = message_index + 1;
     const char *message = NULL;
+    lua_State *C = NULL;
     int args = 0;
-    int ret = 1;
+
+    C = lua_newthread(A);
 
     /* 
      * object[message_title]:(arg1, arg2, ..., argN)
      */
-    lua_rawgeti(A, LUA_REGISTRYINDEX, script->object_ref);
+    lua_pushvalue(A, message_index);
+    lua_xmove(A, C, 1);
+    lua_rawgeti(C, LUA_REGISTRYINDEX, script->object_ref);
 
-    utils_push_table_head(A, message_index);
-    message = lua_tostring(A, -1);
-    lua_gettable(A, -2);
+    utils_push_table_head(C, 1);
+    lua_gettable(C, 2);
 
     /* it's not an error if the function doesn't exist */
-    if (!lua_isfunction(A, -1)) {
-        lua_pop(A, 2); /* whatever isn't a function and the object_ref */
-        goto success;
+    if (!lua_isfunction(C, -1)) {
+        lua_settop(C, 0);
+        return 0;
     }
 
     /* push `self' reference and tail of message which includes the author. */
-    lua_pushvalue(A, object_index);
-    args = utils_push_table_data(A, message_index);
+    lua_pushvalue(C, 2);
+    args = utils_push_table_data(C, 1);
 
-    if (lua_pcall(A, args + 1, 0, 0)) {
-        /* TODO: Figure out why the 'Cannot send message' isn't appearing */
-        lua_pushfstring(A, "Cannot send message `%s': %s", 
-                message, lua_tostring(A, -1));
-        /* push error message beneath pcall error and object_ref */
-        lua_insert(A, lua_gettop(A) - 2);
-        lua_pop(A, 2); /* pcall error and object_ref */
-        
-        /* unload after the object has been popped or it won't gc */
-        script_unload(script, A);
-        goto exit;
-    }
-    
-    lua_pop(A, 1); /* object_ref */
+    /* leave just the method and its arguments */
+    lua_remove(C, 1); /* message */
+    lua_remove(C, 1); /* object */
 
-success:
-    ret = 0;
-exit:
-    return ret;
+    lua_rawgeti(A, message_index, 1);
+    message = lua_tostring(A, -1);
+    lua_pop(A, 1);
+
+    return script_run(script, A, args + 1, message);
+}
+
+/*
+ * Continue the method which yielded in the coroutine on top of A, which is
+ * given the `args' values on top of the coroutine's stack as the results of
+ * its yield. The message (see `script_send') must be at -2.
+ *
+ * Returns the same as `script_send'.
+ */
+int
+script_resume (Script *script, lua_State *A, const int args)
+{
+    const char *message = NULL;
+
+    lua_rawgeti(A, -2, 1);
+    message = lua_tostring(A, -1);
+    lua_pop(A, 1);
+
+    return script_run(script, A, args, message);
 }
 
 /*
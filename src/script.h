@@ -3,6 +3,9 @@
 
 #include "actor.h"
 
+/* a method returns this when it yielded instead of finishing */
+#define SCRIPT_YIELDED 2
+
 typedef struct Script {
     struct Script *prev;
     struct Script *next;
@@ -52,12 +55,27 @@ script_load (Script *script, lua_State *A);
  * error we gain the ability to very easily add new message primitives (the
  * methods themselves) to the system.
  *
- * Returns 0 if successful, 1 if an error occurs. If an error occurs, an error
- * string is pushed onto A.
+ * The method runs in a new coroutine of A, so it may yield (see
+ * `script_resume').
+ *
+ * Returns 0 if successful, with the finished coroutine pushed onto A holding
+ * what the method returned (nothing if there was no method). Returns 1 if an
+ * error occurs, and an error string is pushed onto A. Returns SCRIPT_YIELDED
+ * if the method yielded, with the coroutine pushed onto A.
  */
 int
 script_send (Script *script, lua_State *A);
 
+/*
+ * Continue the method which yielded in the coroutine on top of A, which is
+ * given the `args' values on top of the coroutine's stack as the results of
+ * its yield. The message (see `script_send') must be at -2.
+ *
+ * Returns the same as `script_send'.
+ */
+int
+script_resume (Script *script, lua_State *A, const int args);
+
 /*
  * Access a field and get the results from the object inside the Script.
  *
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+/* values past the last bucket are counted in it */
+#define STATS_LARGEST (((uint64_t) 1 << (STATS_MAGNITUDES + 2)) - 1)
+
+/*
+ * Create zeroed Stats. Returns NULL if there wasn't enough memory.
+ */
+Stats *
+stats_create ()
+{
+    Stats *stats = malloc(sizeof(*stats));
+
+    if (stats)
+        memset(stats, 0, sizeof(*stats));
+
+    return stats;
+}
+
+/*
+ * Nanoseconds on a monotonic clock.
+ */
+uint64_t
+stats_now ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * Add n to a counter. Only the thread which owns the counter may call this.
+ */
+void
+stats_add (uint64_t *counter, const uint64_t n)
+{
+    const uint64_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    __atomic_store_n(counter, value + n, __ATOMIC_RELAXED);
+}
+
+/*
+ * The bucket of a value. Values below STATS_SUB_BUCKETS get a bucket each,
+ * after that each power of two is split into STATS_SUB_BUCKETS buckets.
+ */
+static inline int
+stats_bucket (uint64_t value)
+{
+    int magnitude;
+
+    if (value < STATS_SUB_BUCKETS)
+        return (int) value;
+
+    if (value > STATS_LARGEST)
+        value = STATS_LARGEST;
+
+    magnitude = 63 - __builtin_clzll(value);
+
+    return (magnitude - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS
+        + (int) ((value >> (magnitude - STATS_SUB_BITS))
+                & (STATS_SUB_BUCKETS - 1));
+}
+
+/*
+ * The largest value that falls in the bucket.
+ */
+static inline uint64_t
+stats_bucket_value (const int bucket)
+{
+    const int magnitude = bucket / STATS_SUB_BUCKETS + STATS_SUB_BITS - 1;
+    const uint64_t sub = bucket % STATS_SUB_BUCKETS;
+
+    if (bucket < STATS_SUB_BUCKETS)
+        return bucket;
+
+    return ((STATS_SUB_BUCKETS + sub + 1) << (magnitude - STATS_SUB_BITS)) - 1;
+}
+
+/*
+ * Record the value in the histogram. Only the thread which owns the
+ * histogram may call this.
+ */
+void
+stats_record (Histogram *histogram, const uint64_t value)
+{
+    stats_add(&histogram->counts[stats_bucket(value)], 1);
+    stats_add(&histogram->total, 1);
+
+    if (value > histogram->max)
+        __atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+}
+
+/*
+ * Add the counts of the histogram `from' into `into'.
+ */
+static void
+stats_merge_histogram (Histogram *into, Histogram *from)
+{
+    uint64_t max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+    int i;
+
+    for (i = 0; i < STATS_BUCKETS; i++)
+        into->counts[i] += __atomic_load_n(&from->counts[i], __ATOMIC_RELAXED);
+
+    into->total += __atomic_load_n(&from->total, __ATOMIC_RELAXED);
+
+    if (max > into->max)
+        into->max = max;
+}
+
+/*
+ * Add the counts of `from' into `into'. Safe while `from' is being written.
+ */
+void
+stats_merge (Stats *into, Stats *from)
+{
+    into->processed += __atomic_load_n(&from->processed, __ATOMIC_RELAXED);
+    into->failed += __atomic_load_n(&from->failed, __ATOMIC_RELAXED);
+    into->coalesced += __atomic_load_n(&from->coalesced, __ATOMIC_RELAXED);
+    into->expired += __atomic_load_n(&from->expired, __ATOMIC_RELAXED);
+    into->idle += __atomic_load_n(&from->idle, __ATOMIC_RELAXED);
+    into->busy += __atomic_load_n(&from->busy, __ATOMIC_RELAXED);
+    into->depth += from->depth;
+    stats_merge_histogram(&into->wait, &from->wait);
+    stats_merge_histogram(&into->handler, &from->handler);
+}
+
+/*
+ * Returns the value below which `percentile' percent of the recorded values
+ * fall, 0 if nothing has been recorded.
+ */
+uint64_t
+stats_percentile (Histogram *histogram, const double percentile)
+{
+    uint64_t total = 0, seen = 0, wanted;
+    int i;
+
+    /* the total is counted separately, so sum the buckets which are read */
+    for (i = 0; i < STATS_BUCKETS; i++)
+        total += histogram->counts[i];
+
+    if (total == 0)
+        return 0;
+
+    wanted = (uint64_t) (total * percentile / 100.0 + 0.5);
+
+    if (wanted == 0)
+        wanted = 1;
+
+    for (i = 0; i < STATS_BUCKETS; i++) {
+        seen += histogram->counts[i];
+
+        if (seen >= wanted)
+            break;
+    }
+
+    if (i == STATS_BUCKETS)
+        i--;
+
+    if (stats_bucket_value(i) > histogram->max)
+        return histogram->max;
+
+    return stats_bucket_value(i);
+}
+
+/*
+ * Free the Stats.
+ */
+void
+stats_destroy (Stats *stats)
+{
+    free(stats);
+}
@@ -0,0 +1,90 @@
+/*============================================================================/
+
+    Stats are the counters each Worker keeps about itself: how many Actions
+  it handled, how long it spent handling them or idle, and histograms of how
+  long Actions waited in a mailbox and how long their handlers took.
+
+  Only the Worker's own thread writes its Stats, with plain (relaxed) loads
+  and stores rather than atomic read-modify-writes, so keeping them costs no
+  locked instructions and no cache line bouncing between threads. Any thread
+  may read them at any time and sees counts that are at most a little stale.
+
+  The histograms are log-linear, like HDR histograms: every power of two is
+  split into 8 buckets, so any value is known to within 12.5%. All times are
+  in nanoseconds.
+
+/============================================================================*/
+
+#ifndef DIALOGUE_STATS
+#define DIALOGUE_STATS
+
+#include <stdint.h>
+
+#define STATS_SUB_BITS 3
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_MAGNITUDES 40
+#define STATS_BUCKETS (STATS_MAGNITUDES * STATS_SUB_BUCKETS)
+
+typedef struct Histogram {
+    uint64_t counts[STATS_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} Histogram;
+
+typedef struct Stats {
+    uint64_t processed; /* Actions handled without an error */
+    uint64_t failed; /* Actions whose handler raised an error */
+    uint64_t coalesced; /* stale messages skipped for a newer copy */
+    uint64_t expired; /* Actions dropped because their deadline passed */
+    uint64_t idle; /* time spent waiting for Actions */
+    uint64_t busy; /* time spent in handlers */
+    int depth; /* Actions queued, only set when the Stats are read */
+    Histogram wait; /* from being sent to being handled */
+    Histogram handler; /* from the start of the handler to its end */
+} Stats;
+
+/*
+ * Create zeroed Stats. Returns NULL if there wasn't enough memory.
+ */
+Stats *
+stats_create ();
+
+/*
+ * Nanoseconds on a monotonic clock.
+ */
+uint64_t
+stats_now ();
+
+/*
+ * Add n to a counter. Only the thread which owns the counter may call this.
+ */
+void
+stats_add (uint64_t *counter, const uint64_t n);
+
+/*
+ * Record the value in the histogram. Only the thread which owns the
+ * histogram may call this.
+ */
+void
+stats_record (Histogram *histogram, const uint64_t value);
+
+/*
+ * Add the counts of `from' into `into'. Safe while `from' is being written.
+ */
+void
+stats_merge (Stats *into, Stats *from);
+
+/*
+ * Returns the value below which `percentile' percent of the recorded values
+ * fall, 0 if nothing has been recorded.
+ */
+uint64_t
+stats_percentile (Histogram *histogram, const double percentile);
+
+/*
+ * Free the Stats.
+ */
+void
+stats_destroy (Stats *stats);
+
+#endif
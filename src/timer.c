@@ -0,0 +1,654 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "timer.h"
+#include "director.h"
+
+#define TIMER_LEVELS 4
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_SLOT_MASK (TIMER_SLOTS - 1)
+
+/* the furthest tick the wheel holds, later Actions are cascaded again */
+#define TIMER_SPAN ((uint64_t) 1 << (TIMER_LEVELS * TIMER_SLOT_BITS))
+
+/* handles are the entry's index and the low bits of its generation */
+#define TIMER_INDEX_BITS 20
+#define TIMER_INDEX_MASK ((1 << TIMER_INDEX_BITS) - 1)
+#define TIMER_GENERATION_MASK 0x7ff
+
+#define TIMER_INITIAL_ENTRIES 64
+#define TIMER_INITIAL_FIRED 16
+#define TIMER_NONE -1
+
+typedef struct TimerEntry {
+    Action *action; /* NULL when the entry is free */
+    int thread;
+    int generation; /* bumped every time the entry is freed */
+    int rate; /* 0 for an Action sent only once */
+    int period;
+    uint64_t start; /* the tick a periodic Action was added */
+    uint64_t count; /* times a periodic Action has been sent */
+    uint64_t expires;
+    int slot; /* the wheel slot it is in */
+    int next; /* in the slot, or in the free list */
+    int prev;
+} TimerEntry;
+
+typedef struct TimerFired {
+    Action *action;
+    int thread;
+    int is_once; /* not a copy of a periodic Action */
+} TimerFired;
+
+struct Timer {
+    pthread_t thread;
+    pthread_mutex_t mutex; /* guards all but `fired' */
+    pthread_cond_t cond; /* signaled when there's something to wait for */
+    int is_running;
+    struct timespec epoch; /* when tick 0 was */
+    uint64_t tick; /* the next tick to process */
+    uint64_t wake; /* the tick the thread sleeps until, 0 while it's awake */
+    int slots[TIMER_LEVELS * TIMER_SLOTS]; /* first entry of each slot */
+    TimerEntry *entries;
+    int entry_count;
+    int free_entry;
+    int pending; /* entries in the wheel */
+
+    /* Actions that fired during a tick, sent once the mutex is released */
+    TimerFired *fired;
+    int fired_size;
+    int fired_count;
+};
+
+/*
+ * Milliseconds since the Timer's epoch.
+ */
+static uint64_t
+timer_now (Timer *timer)
+{
+    struct timespec now;
+    int64_t ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (int64_t) (now.tv_sec - timer->epoch.tv_sec) * 1000
+        + (now.tv_nsec - timer->epoch.tv_nsec) / 1000000;
+
+    return ms < 0 ? 0 : (uint64_t) ms;
+}
+
+/*
+ * Put the entry into the slot for when it expires: the first level if it
+ * expires within a turn of it, otherwise the lowest level whose turn covers
+ * it.
+ */
+static void
+timer_link (Timer *timer, const int index)
+{
+    TimerEntry *entry = &timer->entries[index];
+    uint64_t expires = entry->expires;
+    uint64_t delta;
+    int level, slot;
+
+    if (expires < timer->tick)
+        expires = timer->tick;
+
+    delta = expires - timer->tick;
+
+    if (delta >= TIMER_SPAN) {
+        delta = TIMER_SPAN - 1;
+        expires = timer->tick + delta;
+    }
+
+    for (level = 0; level < TIMER_LEVELS - 1; level++)
+        if (delta < (uint64_t) 1 << ((level + 1) * TIMER_SLOT_BITS))
+            break;
+
+    slot = level * TIMER_SLOTS
+        + ((expires >> (level * TIMER_SLOT_BITS)) & TIMER_SLOT_MASK);
+
+    entry->slot = slot;
+    entry->prev = TIMER_NONE;
+    entry->next = timer->slots[slot];
+
+    if (entry->next != TIMER_NONE)
+        timer->entries[entry->next].prev = index;
+
+    timer->slots[slot] = index;
+}
+
+/*
+ * Take the entry out of its slot.
+ */
+static void
+timer_unlink (Timer *timer, const int index)
+{
+    TimerEntry *entry = &timer->entries[index];
+
+    if (entry->prev != TIMER_NONE)
+        timer->entries[entry->prev].next = entry->next;
+    else
+        timer->slots[entry->slot] = entry->next;
+
+    if (entry->next != TIMER_NONE)
+        timer->entries[entry->next].prev = entry->prev;
+
+    entry->slot = TIMER_NONE;
+}
+
+/*
+ * Put the entry back on the free list. Its handle stops being valid.
+ */
+static void
+timer_free_entry (Timer *timer, const int index)
+{
+    TimerEntry *entry = &timer->entries[index];
+
+    entry->action = NULL;
+    entry->generation++;
+    entry->next = timer->free_entry;
+    timer->free_entry = index;
+    timer->pending--;
+}
+
+/*
+ * Take an entry off the free list, doubling the entries if there are none.
+ * Returns the index or TIMER_NONE if there wasn't enough memory.
+ */
+static int
+timer_new_entry (Timer *timer)
+{
+    TimerEntry *entries = NULL;
+    int i, index = TIMER_NONE;
+    int count = timer->entry_count * 2;
+
+    if (timer->free_entry != TIMER_NONE)
+        goto pop;
+
+    if (count > TIMER_INDEX_MASK + 1)
+        goto exit;
+
+    entries = realloc(timer->entries, sizeof(*entries) * count);
+
+    if (!entries)
+        goto exit;
+
+    for (i = timer->entry_count; i < count; i++) {
+        entries[i].action = NULL;
+        entries[i].generation = 0;
+        entries[i].slot = TIMER_NONE;
+        entries[i].next = i + 1 < count ? i + 1 : TIMER_NONE;
+    }
+
+    timer->free_entry = timer->entry_count;
+    timer->entries = entries;
+    timer->entry_count = count;
+
+pop:
+    index = timer->free_entry;
+    timer->free_entry = timer->entries[index].next;
+    timer->pending++;
+exit:
+    return index;
+}
+
+/*
+ * Queue the Action to be sent once the mutex is released. It is dropped if
+ * there isn't enough memory to queue it.
+ */
+static void
+timer_fire (Timer *timer, Action *action, const int thread, const int is_once)
+{
+    TimerFired *fired = NULL;
+
+    if (timer->fired_count == timer->fired_size) {
+        fired = realloc(timer->fired,
+                sizeof(*fired) * timer->fired_size * 2);
+
+        if (!fired) {
+            action_destroy(action);
+
+            if (is_once)
+                director_finish_action(-1);
+            return;
+        }
+
+        timer->fired = fired;
+        timer->fired_size *= 2;
+    }
+
+    timer->fired[timer->fired_count].action = action;
+    timer->fired[timer->fired_count].thread = thread;
+    timer->fired[timer->fired_count].is_once = is_once;
+    timer->fired_count++;
+}
+
+/*
+ * Fire every entry in the slot of the first level. Entries sent once are
+ * freed, periodic ones are linked again for their next time.
+ */
+static void
+timer_expire_slot (Timer *timer, const int slot)
+{
+    TimerEntry *entry = NULL;
+    Action *copy = NULL;
+    int index = timer->slots[slot];
+    int next;
+
+    timer->slots[slot] = TIMER_NONE;
+
+    for (; index != TIMER_NONE; index = next) {
+        entry = &timer->entries[index];
+        next = entry->next;
+
+        if (entry->rate == 0) {
+            timer_fire(timer, entry->action, entry->thread, 1);
+            timer_free_entry(timer, index);
+            continue;
+        }
+
+        copy = action_copy(entry->action);
+
+        if (copy)
+            timer_fire(timer, copy, entry->thread, 0);
+
+        /* skip the times it missed rather than firing them all at once */
+        entry->count++;
+        entry->expires = entry->start
+            + entry->count * entry->period / entry->rate;
+
+        if (entry->expires <= timer->tick)
+            entry->expires = timer->tick + 1;
+
+        timer_link(timer, index);
+    }
+}
+
+/*
+ * Move every entry of the slot down to the levels below.
+ */
+static void
+timer_cascade (Timer *timer, const int slot)
+{
+    int index = timer->slots[slot];
+    int next;
+
+    timer->slots[slot] = TIMER_NONE;
+
+    for (; index != TIMER_NONE; index = next) {
+        next = timer->entries[index].next;
+        timer_link(timer, index);
+    }
+}
+
+/*
+ * Process the next tick. Whenever a level wraps around the next slot of the
+ * level above is cascaded down first.
+ */
+static void
+timer_process_tick (Timer *timer)
+{
+    const uint64_t tick = timer->tick;
+    int level, shift;
+
+    for (level = 1; level < TIMER_LEVELS; level++) {
+        shift = (level - 1) * TIMER_SLOT_BITS;
+
+        if (((tick >> shift) & TIMER_SLOT_MASK) != 0)
+            break;
+
+        shift += TIMER_SLOT_BITS;
+        timer_cascade(timer,
+                level * TIMER_SLOTS + ((tick >> shift) & TIMER_SLOT_MASK));
+    }
+
+    timer_expire_slot(timer, tick & TIMER_SLOT_MASK);
+    timer->tick++;
+}
+
+/*
+ * The next tick with anything to do: the next non-empty slot of the first
+ * level, or the end of its turn, when the level above cascades.
+ */
+static uint64_t
+timer_next_tick (Timer *timer)
+{
+    uint64_t tick = timer->tick;
+
+    do {
+        if (timer->slots[tick & TIMER_SLOT_MASK] != TIMER_NONE)
+            break;
+        tick++;
+    } while ((tick & TIMER_SLOT_MASK) != 0);
+
+    return tick;
+}
+
+/*
+ * Process every tick up to now and send whatever fired. Then sleep until the
+ * next tick with anything to do, or until an Action is added which expires
+ * before it.
+ */
+static void *
+timer_thread (void *arg)
+{
+    Timer *timer = arg;
+    struct timespec deadline;
+    uint64_t now, next;
+    int i;
+
+    pthread_mutex_lock(&timer->mutex);
+
+    while (timer->is_running) {
+        if (timer->pending == 0) {
+            timer->wake = UINT64_MAX;
+            pthread_cond_wait(&timer->cond, &timer->mutex);
+            timer->wake = 0;
+            continue;
+        }
+
+        now = timer_now(timer);
+
+        while (timer->tick <= now && timer->pending > 0)
+            timer_process_tick(timer);
+
+        if (timer->fired_count > 0) {
+            pthread_mutex_unlock(&timer->mutex);
+
+            /* 
+             * An Action sent once stays in flight (see `timer_after') until
+             * the Director has counted it again for itself.
+             */
+            for (i = 0; i < timer->fired_count; i++) {
+                director_give_action(timer->fired[i].action,
+                        timer->fired[i].thread);
+
+                if (timer->fired[i].is_once)
+                    director_finish_action(-1);
+            }
+
+            timer->fired_count = 0;
+            pthread_mutex_lock(&timer->mutex);
+            continue;
+        }
+
+        if (timer->pending == 0)
+            continue;
+
+        next = timer_next_tick(timer);
+        deadline.tv_sec = timer->epoch.tv_sec + next / 1000;
+        deadline.tv_nsec = timer->epoch.tv_nsec + (next % 1000) * 1000000;
+
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        timer->wake = next;
+        pthread_cond_timedwait(&timer->cond, &timer->mutex, &deadline);
+        timer->wake = 0;
+    }
+
+    pthread_mutex_unlock(&timer->mutex);
+    action_pool_clear();
+
+    return NULL;
+}
+
+/*
+ * Create the Timer and start its thread. The thread sleeps until an Action
+ * is added. Returns NULL on failure.
+ */
+Timer *
+timer_start ()
+{
+    pthread_condattr_t attr;
+    Timer *timer = malloc(sizeof(*timer));
+    int i;
+
+    if (!timer)
+        goto exit;
+
+    timer->entries = malloc(sizeof(TimerEntry) * TIMER_INITIAL_ENTRIES);
+
+    if (!timer->entries)
+        goto free_timer;
+
+    timer->fired = malloc(sizeof(TimerFired) * TIMER_INITIAL_FIRED);
+
+    if (!timer->fired)
+        goto free_entries;
+
+    for (i = 0; i < TIMER_INITIAL_ENTRIES; i++) {
+        timer->entries[i].action = NULL;
+        timer->entries[i].generation = 0;
+        timer->entries[i].slot = TIMER_NONE;
+        timer->entries[i].next =
+            i + 1 < TIMER_INITIAL_ENTRIES ? i + 1 : TIMER_NONE;
+    }
+
+    for (i = 0; i < TIMER_LEVELS * TIMER_SLOTS; i++)
+        timer->slots[i] = TIMER_NONE;
+
+    timer->entry_count = TIMER_INITIAL_ENTRIES;
+    timer->free_entry = 0;
+    timer->pending = 0;
+    timer->fired_size = TIMER_INITIAL_FIRED;
+    timer->fired_count = 0;
+    timer->is_running = 1;
+    timer->tick = 0;
+    timer->wake = 0;
+    clock_gettime(CLOCK_MONOTONIC, &timer->epoch);
+
+    /* sleep against the same clock the ticks are counted with */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&timer->mutex, NULL);
+
+    if (pthread_create(&timer->thread, NULL, timer_thread, timer) != 0)
+        goto destroy_sync;
+
+    goto exit;
+
+destroy_sync:
+    pthread_mutex_destroy(&timer->mutex);
+    pthread_cond_destroy(&timer->cond);
+    free(timer->fired);
+free_entries:
+    free(timer->entries);
+free_timer:
+    free(timer);
+    timer = NULL;
+exit:
+    return timer;
+}
+
+/*
+ * Add an entry for the Action which first expires `delay' milliseconds from
+ * now. Returns the handle, or -1 if there wasn't enough memory.
+ *
+ * The wheel's tick lags behind the clock while the thread sleeps, by up to a
+ * turn of the first level, so the expiry is counted from the clock instead.
+ * The thread processes every tick up to now when it wakes, so it still finds
+ * the entry in its slot.
+ */
+static int
+timer_add (Timer *timer, Action *action, const int thread, const int delay,
+        const int rate, const int period)
+{
+    TimerEntry *entry = NULL;
+    int index, handle = -1;
+    uint64_t now;
+
+    pthread_mutex_lock(&timer->mutex);
+    now = timer_now(timer);
+
+    /* nothing is in the wheel, so it can skip straight to now */
+    if (timer->pending == 0)
+        timer->tick = now;
+
+    index = timer_new_entry(timer);
+
+    if (index == TIMER_NONE)
+        goto unlock;
+
+    entry = &timer->entries[index];
+    entry->action = action;
+    entry->thread = thread;
+    entry->rate = rate;
+    entry->period = period;
+    entry->start = now;
+    entry->count = rate > 0 ? 1 : 0;
+    entry->expires = now + (delay > 0 ? delay : 0);
+    timer_link(timer, index);
+
+    handle = ((entry->generation & TIMER_GENERATION_MASK) << TIMER_INDEX_BITS)
+        | index;
+
+    /* the thread would sleep past it */
+    if (entry->expires < timer->wake)
+        pthread_cond_signal(&timer->cond);
+
+unlock:
+    pthread_mutex_unlock(&timer->mutex);
+    return handle;
+}
+
+/*
+ * Send the Action to the Director with the given thread requirement after
+ * `delay' milliseconds. The Timer owns the Action afterwards.
+ *
+ * The caller counts the Action as in flight, so waiting for the Director to
+ * go idle waits for it. The Timer finishes it (see `director_finish_action')
+ * once it has been sent, cancelled or cleared.
+ *
+ * Returns the handle, or -1 if there wasn't enough memory.
+ */
+int
+timer_after (Timer *timer, Action *action, const int thread, const int delay)
+{
+    return timer_add(timer, action, thread, delay, 0, 0);
+}
+
+/*
+ * Send a copy of the Action to the Director with the given thread
+ * requirement `rate' times every `period' milliseconds, starting one interval
+ * from now. The times are kept relative to the start, so the Action doesn't
+ * drift even if the interval isn't a whole number of milliseconds. The Timer
+ * owns the Action afterwards.
+ *
+ * Returns the handle, or -1 if there wasn't enough memory.
+ */
+int
+timer_every (Timer *timer, Action *action, const int thread, const int rate,
+        const int period)
+{
+    return timer_add(timer, action, thread, period / rate, rate, period);
+}
+
+/*
+ * Cancel the Action with the handle. Returns 1 if it was cancelled, 0 if the
+ * handle isn't pending (it already fired or was cancelled).
+ */
+int
+timer_cancel (Timer *timer, const int handle)
+{
+    const int index = handle & TIMER_INDEX_MASK;
+    const int generation = (handle >> TIMER_INDEX_BITS)
+        & TIMER_GENERATION_MASK;
+    TimerEntry *entry = NULL;
+    int is_cancelled = 0;
+    int is_once = 0;
+
+    if (handle < 0)
+        return 0;
+
+    pthread_mutex_lock(&timer->mutex);
+
+    if (index >= timer->entry_count)
+        goto unlock;
+
+    entry = &timer->entries[index];
+
+    if (!entry->action
+            || (entry->generation & TIMER_GENERATION_MASK) != generation)
+        goto unlock;
+
+    is_once = entry->rate == 0;
+    timer_unlink(timer, index);
+    action_destroy(entry->action);
+    timer_free_entry(timer, index);
+    is_cancelled = 1;
+
+unlock:
+    pthread_mutex_unlock(&timer->mutex);
+
+    if (is_once)
+        director_finish_action(-1);
+
+    return is_cancelled;
+}
+
+/*
+ * Destroy every Action which hasn't fired yet, as if each was cancelled.
+ * Returns how many of them were to be sent once.
+ */
+int
+timer_clear (Timer *timer)
+{
+    TimerEntry *entry = NULL;
+    int i, cleared = 0;
+
+    pthread_mutex_lock(&timer->mutex);
+
+    for (i = 0; i < timer->entry_count; i++) {
+        entry = &timer->entries[i];
+
+        if (!entry->action)
+            continue;
+
+        if (entry->rate == 0)
+            cleared++;
+
+        timer_unlink(timer, i);
+        action_destroy(entry->action);
+        timer_free_entry(timer, i);
+    }
+
+    pthread_mutex_unlock(&timer->mutex);
+
+    for (i = 0; i < cleared; i++)
+        director_finish_action(-1);
+
+    return cleared;
+}
+
+/*
+ * Stop the Timer's thread, destroy the Actions which haven't fired and free
+ * the Timer.
+ */
+void
+timer_stop (Timer *timer)
+{
+    int i;
+
+    pthread_mutex_lock(&timer->mutex);
+    timer->is_running = 0;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->mutex);
+
+    pthread_join(timer->thread, NULL);
+
+    for (i = 0; i < timer->entry_count; i++)
+        if (timer->entries[i].action)
+            action_destroy(timer->entries[i].action);
+
+    pthread_mutex_destroy(&timer->mutex);
+    pthread_cond_destroy(&timer->cond);
+    free(timer->fired);
+    free(timer->entries);
+    free(timer);
+}
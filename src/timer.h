@@ -0,0 +1,80 @@
+/*============================================================================/
+
+    The Timer is a single thread which sends Actions to the Director later,
+  either once after a delay or periodically, until they're cancelled.
+
+  Pending Actions sit in a hierarchical timer wheel: four levels of 64 slots
+  where a slot of the first level is one tick (a millisecond) and a slot of
+  each level above spans a whole turn of the level below it. Adding or
+  cancelling an Action is O(1) and so is each tick, no matter how many
+  Actions are waiting. When the first level wraps around, the next slot of the
+  level above is cascaded down into it.
+
+  Every Action is known by a handle, an integer which stays valid until the
+  Action is cancelled or fires for the last time. Handles are never reused
+  while their Action is still pending.
+
+/============================================================================*/
+
+#ifndef DIALOGUE_TIMER
+#define DIALOGUE_TIMER
+
+#include "action.h"
+
+typedef struct Timer Timer;
+
+/*
+ * Create the Timer and start its thread. The thread sleeps until an Action
+ * is added. Returns NULL on failure.
+ */
+Timer *
+timer_start ();
+
+/*
+ * Send the Action to the Director with the given thread requirement after
+ * `delay' milliseconds. The Timer owns the Action afterwards.
+ *
+ * The caller counts the Action as in flight, so waiting for the Director to
+ * go idle waits for it. The Timer finishes it (see `director_finish_action')
+ * once it has been sent, cancelled or cleared.
+ *
+ * Returns the handle, or -1 if there wasn't enough memory.
+ */
+int
+timer_after (Timer *timer, Action *action, const int thread, const int delay);
+
+/*
+ * Send a copy of the Action to the Director with the given thread
+ * requirement `rate' times every `period' milliseconds, starting one interval
+ * from now. The times are kept relative to the start, so the Action doesn't
+ * drift even if the interval isn't a whole number of milliseconds. The Timer
+ * owns the Action afterwards.
+ *
+ * Returns the handle, or -1 if there wasn't enough memory.
+ */
+int
+timer_every (Timer *timer, Action *action, const int thread, const int rate,
+        const int period);
+
+/*
+ * Cancel the Action with the handle. Returns 1 if it was cancelled, 0 if the
+ * handle isn't pending (it already fired or was cancelled).
+ */
+int
+timer_cancel (Timer *timer, const int handle);
+
+/*
+ * Destroy every Action which hasn't fired yet, as if each was cancelled.
+ * Returns how many of them were to be sent once.
+ */
+int
+timer_clear (Timer *timer);
+
+/*
+ * Stop the Timer's thread, destroy the Actions which haven't fired and free
+ * the Timer.
+ */
+void
+timer_stop (Timer *timer);
+
+#endif
@@ -1,19 +1,78 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* CPU affinity */
+#endif
+
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <pthread.h>
+#include <sched.h>
+#ifdef __linux__
 #include <unistd.h>
-#include <errno.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
 #include "console.h"
 #include "worker.h"
+#include "mailbox.h"
+#include "stats.h"
+#include "director.h"
 #include "company.h"
-#include "utils.h"
+
+/*
+ * Bounds for the adaptive spin a Worker does before parking. The Worker spins
+ * longer when mail tends to arrive while it spins and shorter when it doesn't.
+ */
+#define WORKER_SPIN_MIN 16
+#define WORKER_SPIN_MAX 4096
+
+/* 
+ * A Worker's thread reports back through this once it has created the
+ * Worker, see `worker_boot'.
+ */
+typedef struct WorkerBoot {
+    int id;
+    int nice;
+    int is_ready;
+    struct Worker *worker;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} WorkerBoot;
+
+/* the Worker whose thread is running, NULL outside of Worker threads */
+static __thread Worker *current_worker = NULL;
 
 struct Worker {
     lua_State *L; /* worker state */
-    lua_State *M; /* mailbox stack */
+    Mailbox *control; /* high priority Actions, handled before all others */
+    Mailbox *pinned; /* Actions only this Worker may handle */
+    Mailbox *shared; /* Actions any idle Worker may steal */
     pthread_t thread;
-    pthread_mutex_t mail_mutex;
+    pthread_mutex_t steal_mutex; /* serializes the consumers of `shared' */
+    pthread_mutex_t mail_mutex; /* only guards parking */
     pthread_mutex_t state_mutex;
+    pthread_cond_t mail_cond; /* signaled when a parked Worker gets mail */
+    int is_parked;
+    int is_signaled; /* woken up to look for Actions to steal */
+    int spin; /* current spin limit before parking */
+    Stats *stats; /* only written by the Worker's thread */
+    int dropping_pinned; /* oldest pinned Actions to throw away */
+    int dropping_shared; /* oldest shared Actions to throw away */
+    int queued; /* Actions in the queues of Actors dispatched to it */
+    int is_stopped; /* its thread was joined, see `worker_stop' */
     int id;
+
+    /* Actions drained from the mailboxes, handled in arrival order */
+    Action **batch_actions; /* kept serialized until each is handled */
+    uint64_t batch_started; /* when the current Action's handler started */
+    int batch_size; /* the most Actions drained at once */
+    int batch_limit; /* the most Actions in this batch, see `worker_pump' */
+    int batch_count;
+    int batch_next;
+    int quantum; /* the most Actions of one Actor in a batch */
+    int running; /* the Actor whose run token was popped, -1 if none */
+    int taken; /* Actions of the running Actor in the batch so far */
+    int has_credit; /* the running Actor has time left in its turn */
 };
 
 /*
@@ -28,11 +87,14 @@ struct Worker {
  * Examples:
  * {a0, "load"} => a0:load()
  * {a0, "send", {"draw", "player.jpg"}} => a0:send{"draw", "player.jpg"}
+ *
+ * The one Action which isn't for an Actor answers an `ask' of this Worker:
+ * {"callback", worker, id [, arg1 [, ... [, argN]]]}
  */
 int
 worker_catch (lua_State *W)
 {
-    int i, len;
+    int i, len, worker_id, callback_id;
     const int action_arg = 1;
     const char *message = NULL;
     /* positions within the Action table */
@@ -49,6 +111,22 @@ worker_catch (lua_State *W)
                 len);
 
     lua_rawgeti(W, action_arg, actor_pos);
+
+    if (lua_type(W, -1) == LUA_TSTRING 
+            && strcmp(lua_tostring(W, -1), "callback") == 0) {
+        lua_rawgeti(W, action_arg, method_pos);
+        lua_rawgeti(W, action_arg, args_pos);
+        worker_id = lua_tointeger(W, -2);
+        callback_id = luaL_checkinteger(W, -1);
+        lua_pop(W, 2);
+
+        for (i = args_pos + 1; i <= len; i++)
+            lua_rawgeti(W, action_arg, i);
+
+        director_callback(worker_id, callback_id, len - args_pos);
+        return 0;
+    }
+
     company_push_actor(W, company_actor_id(W, -1));
 
     lua_rawgeti(W, action_arg, method_pos);
@@ -74,50 +152,479 @@ worker_catch (lua_State *W)
     return 0;
 }
 
+/*
+ * Handle the Action in the Worker's state. An Action which calls a method by
+ * code (see `action_method') calls the method's function with its values
+ * directly, anything else goes through `worker_catch'.
+ */
+static void
+worker_handle (lua_State *W, Action *action)
+{
+    int count;
+
+    if (action->method == ACTION_CALL) {
+        lua_pushcfunction(W, worker_catch);
+        action_push(action, W);
+        lua_call(W, 1, 0);
+        return;
+    }
+
+    lua_pushcfunction(W, company_method(action->method));
+    count = action_push_values(action, W);
+    lua_call(W, count, 0);
+}
+
+/*
+ * Add the Action to the end of the batch, unless it is a stale message with
+ * a newer copy queued (see `director_is_stale') or its deadline has passed,
+ * in which case it is destroyed.
+ */
+static void
+worker_batch_add (Worker *worker, Action *action)
+{
+    if (director_is_stale(action)) {
+        stats_add(&worker->stats->coalesced, 1);
+        director_finish_action(action->actor);
+        action_destroy(action);
+        return;
+    }
+
+    if (action_deadline(action) < stats_now()) {
+        stats_add(&worker->stats->expired, 1);
+        director_finish_action(action->actor);
+        action_destroy(action);
+        return;
+    }
+
+    worker->batch_actions[worker->batch_count++] = action;
+}
+
+/*
+ * Add the next Action of the running Actor to the batch unless its turn is
+ * over: it has had `quantum' Actions, it has used up its time (see
+ * `director_charge_actor') or the batch is full. Returns 1 if an Action was
+ * added.
+ */
+static int
+worker_batch_refill (Worker *worker)
+{
+    const int count = worker->batch_count;
+    Action *action = NULL;
+
+    /* an Action which was thrown away or was stale isn't added */
+    while (worker->batch_count == count) {
+        if (worker->running < 0 || !worker->has_credit
+                || worker->taken >= worker->quantum
+                || worker->batch_count >= worker->batch_limit)
+            return 0;
+
+        action = director_inbox_action(worker->running);
+
+        if (!action)
+            return 0;
+
+        worker_batch_add(worker, action);
+    }
+
+    worker->taken++;
+    return 1;
+}
+
+/*
+ * Charge the running Actor for the time its Action at the front of the batch
+ * took, if the Action was its.
+ */
 static inline void
-worker_process_action (lua_State *W, Worker *worker)
+worker_batch_charge (Worker *worker, const uint64_t elapsed)
 {
-    lua_pushcfunction(W, worker_catch);
-    lua_insert(W, -2);
-    if (lua_pcall(W, 1, 0, 0)) {
+    const int actor = worker->batch_actions[worker->batch_next - 1]->actor;
+
+    if (actor > -1 && actor == worker->running)
+        worker->has_credit = director_charge_actor(actor, elapsed);
+}
+
+/*
+ * Move past the next Action of the batch, which has been handled (or failed),
+ * and destroy it.
+ */
+static inline void
+worker_batch_advance (Worker *worker)
+{
+    Action *action = worker->batch_actions[worker->batch_next - 1];
+
+    director_finish_action(action->actor);
+    action_destroy(action);
+    worker->batch_next++;
+}
+
+/*
+ * Handle the Actions of the batch in order, starting with the next one. The
+ * running Actor's Actions are taken one at a time, for as long as its turn
+ * lasts. An Action whose deadline passed while it sat in the batch is
+ * dropped without running its handler. The Worker is the only argument. An
+ * error in any Action unwinds out of this function with `batch_next' still
+ * pointing at the Action which failed.
+ */
+static int
+worker_catch_batch (lua_State *W)
+{
+    Worker *worker = lua_touserdata(W, 1);
+    Stats *stats = worker->stats;
+    Action *action = NULL;
+    uint64_t now;
+
+    while (worker->batch_next <= worker->batch_count 
+            || worker_batch_refill(worker)) {
+        action = worker->batch_actions[worker->batch_next - 1];
+        now = stats_now();
+
+        if (action_deadline(action) < now) {
+            stats_add(&stats->expired, 1);
+            worker_batch_advance(worker);
+            continue;
+        }
+
+        worker->batch_started = now;
+        stats_record(&stats->wait, now - action->sent);
+
+        /* what the handler sends is delivered together when it's done */
+        director_batch_begin();
+        worker_handle(W, action);
+        director_batch_end();
+
+        now = stats_now() - worker->batch_started;
+        stats_record(&stats->handler, now);
+        stats_add(&stats->busy, now);
+        stats_add(&stats->processed, 1);
+        worker_batch_charge(worker, now);
+        worker_batch_advance(worker);
+    }
+
+    return 0;
+}
+
+/*
+ * Handle the whole batch inside one protected call. If an Action fails, the
+ * error is logged and the protected call is made again for the Actions after
+ * it, so one bad Action never costs the rest of the batch.
+ */
+static void
+worker_run_batch (Worker *worker)
+{
+    lua_State *W = worker->L;
+    uint64_t elapsed;
+
+    while (worker->batch_next <= worker->batch_count) {
+        lua_pushcfunction(W, worker_catch_batch);
+        lua_pushlightuserdata(W, worker);
+
+        if (lua_pcall(W, 1, 0, 0) == 0)
+            break;
+
         console_log("Action failed: %s\n", lua_tostring(W, -1));
+        director_batch_end(); /* what it sent before failing still goes */
+        elapsed = stats_now() - worker->batch_started;
+        stats_add(&worker->stats->busy, elapsed);
+        stats_add(&worker->stats->failed, 1);
+        worker_batch_charge(worker, elapsed);
         lua_pop(W, 1);
+        worker_batch_advance(worker);
+    }
+}
+
+/*
+ * Returns 1 (true) if either of the Worker's mailboxes has Actions.
+ */
+static inline int
+worker_has_mail (Worker *worker)
+{
+    return mailbox_count(worker->control) > 0
+        || mailbox_count(worker->pinned) > 0 
+        || mailbox_count(worker->shared) > 0;
+}
+
+/*
+ * Wake the Worker if it is parked, either because an Action has been pushed
+ * to it or so it can look for Actions to steal. Returns 0 if the Worker was
+ * parked, 1 otherwise.
+ *
+ * The parked flag and the Mailbox counts are all sequentially consistent, so
+ * either the Worker sees the new Action before it parks or we see that it is
+ * parked. Taking the mutex before signaling makes sure the Worker is actually
+ * waiting on the condition and won't miss it.
+ */
+int
+worker_wake (Worker *worker)
+{
+    if (!__atomic_load_n(&worker->is_parked, __ATOMIC_SEQ_CST))
+        return 1;
+
+    pthread_mutex_lock(&worker->mail_mutex);
+    worker->is_signaled = 1;
+    pthread_cond_signal(&worker->mail_cond);
+    pthread_mutex_unlock(&worker->mail_mutex);
+    return 0;
+}
+
+/*
+ * Pop the oldest Action of one of the Worker's mailboxes, after throwing
+ * away as many of its oldest normal Actions as the drop-oldest policy asked
+ * for (see `worker_drop_oldest'). Run tokens aren't thrown away, they stand
+ * for an Actor's whole queue. If the mailbox runs empty first there is room
+ * again, so the rest of the requests are forgotten.
+ */
+static Action *
+worker_pop (Mailbox *mailbox, int *dropping)
+{
+    Action *action = NULL;
+
+    while ((action = mailbox_pop(mailbox))) {
+        if (__atomic_load_n(dropping, __ATOMIC_ACQUIRE) == 0
+                || action->priority != ACTION_NORMAL
+                || director_run_token(action) > -1 
+                || action_is_empty(action))
+            return action;
+
+        __atomic_sub_fetch(dropping, 1, __ATOMIC_ACQ_REL);
+        director_drop_oldest(action);
+    }
+
+    if (mailbox_count(mailbox) == 0)
+        __atomic_store_n(dropping, 0, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+/*
+ * Pop the next Action for the Worker. High priority Actions come first, then
+ * Actions pinned to this Worker, then its shared Actions, and then whatever
+ * can be stolen from the other Workers. Returns NULL if there's nothing to do
+ * anywhere.
+ */
+static Action *
+worker_next_action (Worker *worker)
+{
+    Action *action = mailbox_pop(worker->control);
+
+    if (action)
+        goto exit;
+
+    action = worker_pop(worker->pinned, &worker->dropping_pinned);
+
+    if (action)
+        goto exit;
+
+    if (mailbox_count(worker->shared) > 0) {
+        pthread_mutex_lock(&worker->steal_mutex);
+        action = worker_pop(worker->shared, &worker->dropping_shared);
+        pthread_mutex_unlock(&worker->steal_mutex);
+
+        if (action)
+            goto exit;
     }
+
+    action = director_steal_action(worker->id);
+exit:
+    return action;
+}
+
+/*
+ * Wait for an Action. The Worker first spins for a short while because the
+ * next Action of a conversation between Actors usually arrives within
+ * microseconds. If nothing shows up it parks on the mailbox's condition
+ * variable until `worker_wake' wakes it.
+ *
+ * Returns the Action if one was found while spinning, otherwise NULL after
+ * being woken up.
+ */
+static Action *
+worker_wait_for_action (Worker *worker)
+{
+    Action *action = NULL;
+    int i;
+
+    for (i = 0; i < worker->spin; i++) {
+        action = worker_next_action(worker);
+
+        if (action) {
+            if (worker->spin < WORKER_SPIN_MAX)
+                worker->spin *= 2;
+            goto exit;
+        }
+
+        sched_yield();
+    }
+
+    if (worker->spin > WORKER_SPIN_MIN)
+        worker->spin /= 2;
+
+    pthread_mutex_lock(&worker->mail_mutex);
+    __atomic_store_n(&worker->is_parked, 1, __ATOMIC_SEQ_CST);
+    while (!worker_has_mail(worker) && !worker->is_signaled)
+        pthread_cond_wait(&worker->mail_cond, &worker->mail_mutex);
+    worker->is_signaled = 0;
+    __atomic_store_n(&worker->is_parked, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&worker->mail_mutex);
+
+exit:
+    return action;
+}
+
+/*
+ * Start the turn of the Actor whose run token was popped, adding its first
+ * Action to the batch. An Actor which
+ * still owes time from its earlier turns gets none this round (see
+ * `director_begin_turn'), it is only put back in line.
+ */
+static void
+worker_batch_actor (Worker *worker, const int actor)
+{
+    worker->running = actor;
+    worker->taken = 0;
+    worker->has_credit = director_begin_turn(actor);
+    worker_batch_refill(worker);
 }
 
 /*
- * The Worker check its mailbox every loop. If no actions have been sent, it 
- * sleeps for a period and then checks again. It checks for a `nil' action as a
- * sentinel to quit.
+ * Drain up to `batch_limit' Actions into the batch in the order they
+ * were popped. If is_waiting, waits (see `worker_wait_for_action') when
+ * there's nothing at all to do, otherwise the batch is left empty. Popping
+ * an Actor's run token ends the batch with that Actor's Actions, so it is
+ * released as soon as they're handled. Returns 1 if the `nil' sentinel was
+ * drained, which means the Worker should stop after this batch.
+ */
+static int
+worker_fill_batch (Worker *worker, const int is_waiting)
+{
+    Action *action = NULL;
+    int is_stopping = 0;
+    int actor;
+    uint64_t idle;
+
+    worker->batch_count = 0;
+    worker->batch_next = 1;
+
+    while (worker->batch_count < worker->batch_limit) {
+        action = worker_next_action(worker);
+
+        if (!action) {
+            /* don't sit on Actions already drained */
+            if (worker->batch_count > 0 || !is_waiting)
+                break;
+
+            idle = stats_now();
+            action = worker_wait_for_action(worker);
+            stats_add(&worker->stats->idle, stats_now() - idle);
+
+            if (!action)
+                continue;
+        }
+
+        actor = director_run_token(action);
+
+        if (actor > -1) {
+            worker_batch_actor(worker, actor);
+            break;
+        }
+
+        if (action_is_empty(action)) {
+            action_destroy(action);
+            is_stopping = 1;
+            break;
+        }
+
+        worker_batch_add(worker, action);
+    }
+
+    return is_stopping;
+}
+
+/*
+ * Release the Actor the Worker was running, if any, now that its batch is
+ * done.
+ */
+static inline void
+worker_release (Worker *worker)
+{
+    if (worker->running > -1) {
+        director_release_actor(worker->running);
+        worker->running = -1;
+    }
+}
+
+/*
+ * The Worker drains a batch from its mailboxes every loop and handles it. If
+ * no actions have been sent, it tries to steal one from the other Workers and
+ * then waits until one is delivered (see `worker_wait_for_action'). It checks
+ * for a `nil' action as a sentinel to quit.
  */
 void *
 worker_thread (void *arg)
 {
     Worker *worker = arg;
-    lua_State *W = worker->L;
-    lua_State *M = worker->M;
+    int is_stopping = 0;
 
+    current_worker = worker;
     pthread_mutex_lock(&worker->state_mutex);
 
-    while (1) {
-        pthread_mutex_lock(&worker->mail_mutex);
-        utils_transfer(W, M, lua_gettop(M));
-        pthread_mutex_unlock(&worker->mail_mutex);
+    while (!is_stopping) {
+        is_stopping = worker_fill_batch(worker, 1);
+        worker_run_batch(worker);
+        worker_release(worker);
+    }
+
+    pthread_mutex_unlock(&worker->state_mutex);
+    action_pool_clear();
 
-        if (lua_gettop(W) == 0) {
-            usleep(1000);
-            continue;
-        }
+    return NULL;
+}
 
-        if (lua_isnil(W, -1))
+/*
+ * Handle the Worker's Actions on the calling thread without ever waiting for
+ * more, which is how a Worker without a thread of its own is run from a
+ * host's loop (see `director_pump'). Batches are drained and handled until
+ * nothing is queued, `max_actions' Actions have been taken or `max_ms'
+ * milliseconds have passed, where 0 is no limit. The time is checked between
+ * batches, so a slow handler can run over it.
+ *
+ * Returns the number of Actions taken, or -1 if another thread is running
+ * the Worker (or this one already is, further up its stack).
+ */
+int
+worker_pump (Worker *worker, const int max_ms, const int max_actions)
+{
+    const uint64_t end = stats_now() + (uint64_t) max_ms * 1000000;
+    Worker *caller = current_worker;
+    int taken = 0, is_stopping = 0;
+
+    if (pthread_mutex_trylock(&worker->state_mutex) != 0)
+        return -1;
+
+    current_worker = worker;
+
+    while (!is_stopping) {
+        if (max_actions > 0 && max_actions - taken < worker->batch_size)
+            worker->batch_limit = max_actions - taken;
+
+        is_stopping = worker_fill_batch(worker, 0);
+
+        if (worker->batch_count == 0 && worker->running < 0)
             break;
 
-        worker_process_action(W, worker);
+        worker_run_batch(worker);
+        worker_release(worker);
+        taken += worker->batch_count;
+
+        if ((max_actions > 0 && taken >= max_actions)
+                || (max_ms > 0 && stats_now() >= end))
+            break;
     }
 
+    worker->batch_limit = worker->batch_size;
+    current_worker = caller;
     pthread_mutex_unlock(&worker->state_mutex);
 
-    return NULL;
+    return taken;
 }
 
 /*
@@ -134,93 +641,512 @@ worker_create (const int id)
 
     worker->L = luaL_newstate();
 
-    if (!worker->L) {
-        free(worker);
-        worker = NULL;
-        goto exit;
-    }
+    if (!worker->L)
+        goto free_worker;
 
-    worker->M = luaL_newstate();
+    worker->control = mailbox_create();
 
-    if (!worker->M) {
-        lua_close(worker->L);
-        free(worker);
-        worker = NULL;
-        goto exit;
-    }
+    if (!worker->control)
+        goto close_state;
+
+    worker->pinned = mailbox_create();
+
+    if (!worker->pinned)
+        goto destroy_control;
+
+    worker->shared = mailbox_create();
+
+    if (!worker->shared)
+        goto destroy_pinned;
+
+    worker->batch_size = dialogue_option_get(WORKER_BATCH);
+    worker->batch_limit = worker->batch_size;
+    worker->quantum = dialogue_option_get(ACTOR_QUANTUM);
+    worker->running = -1;
+    worker->taken = 0;
+    worker->has_credit = 0;
+    worker->batch_actions = malloc(sizeof(Action*) * worker->batch_size);
+
+    if (!worker->batch_actions)
+        goto destroy_shared;
+
+    worker->stats = stats_create();
+
+    if (!worker->stats)
+        goto free_actions;
 
     worker->id = id;
+    worker->thread = pthread_self(); /* worker_start creates it in its thread */
+    worker->is_parked = 0;
+    worker->is_signaled = 0;
+    worker->spin = WORKER_SPIN_MIN;
+    worker->dropping_pinned = 0;
+    worker->dropping_shared = 0;
+    worker->queued = 0;
+    worker->is_stopped = 0;
     /* thread ids are not 0 offset */
     lua_pushinteger(worker->L, worker->id + 1);
     lua_setglobal(worker->L, "__worker_id");
 
     luaL_openlibs(worker->L);
     company_set(worker->L);
+
+    worker->batch_count = 0;
+    worker->batch_next = 1;
+
+    pthread_mutex_init(&worker->steal_mutex, NULL);
     pthread_mutex_init(&worker->mail_mutex, NULL);
     pthread_mutex_init(&worker->state_mutex, NULL);
+    pthread_cond_init(&worker->mail_cond, NULL);
+    goto exit;
 
+free_actions:
+    free(worker->batch_actions);
+destroy_shared:
+    mailbox_destroy(worker->shared);
+destroy_pinned:
+    mailbox_destroy(worker->pinned);
+destroy_control:
+    mailbox_destroy(worker->control);
+close_state:
+    lua_close(worker->L);
+free_worker:
+    free(worker);
+    worker = NULL;
 exit:
     return worker;
 }
 
+#ifdef __linux__
+/*
+ * Parse a list of CPUs like "0-3,8,10-11" into the set. Returns the number of
+ * CPUs in the set, 0 if the list is malformed.
+ */
+static int
+worker_parse_cpus (const char *list, cpu_set_t *set)
+{
+    const char *c = list;
+    char *end = NULL;
+    long first, last;
+
+    CPU_ZERO(set);
+
+    while (*c) {
+        first = strtol(c, &end, 10);
+
+        if (end == c || first < 0)
+            return 0;
+
+        last = first;
+        c = end;
+
+        if (*c == '-') {
+            c++;
+            last = strtol(c, &end, 10);
+
+            if (end == c || last < first)
+                return 0;
+
+            c = end;
+        }
+
+        if (last >= CPU_SETSIZE)
+            return 0;
+
+        for (; first <= last; first++)
+            CPU_SET(first, set);
+
+        if (*c == ',')
+            c++;
+        else if (*c)
+            return 0;
+    }
+
+    return CPU_COUNT(set);
+}
+#endif
+
 /*
- * Create a Worker and start it, spawning a thread.
+ * Pin the calling thread to the CPU of the Worker with the id: the id'th CPU
+ * of the `-a' list, wrapping around if there are more Workers than CPUs. Does
+ * nothing if no list was given.
+ */
+void
+worker_place (const int id)
+{
+#ifdef __linux__
+    const char *list = dialogue_cpus();
+    cpu_set_t cpus, cpu;
+    int i, n, count;
+
+    if (!list)
+        return;
+
+    count = worker_parse_cpus(list, &cpus);
+
+    if (count == 0) {
+        fprintf(stderr, "Worker: bad CPU list `%s', not pinning!\n", list);
+        return;
+    }
+
+    CPU_ZERO(&cpu);
+
+    for (i = 0, n = id % count; i < CPU_SETSIZE; i++) {
+        if (!CPU_ISSET(i, &cpus))
+            continue;
+
+        if (n-- == 0) {
+            CPU_SET(i, &cpu);
+            break;
+        }
+    }
+
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu);
+#else
+    (void) id;
+#endif
+}
+
+/*
+ * Pin the Worker's thread to the CPUs in a list like "0-3,8". Memory it has
+ * already touched stays where it is. Returns 0 if successful, 1 if the list
+ * is malformed or pinning isn't supported.
+ */
+int
+worker_pin (Worker *worker, const char *list)
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+
+    if (worker_parse_cpus(list, &cpus) == 0)
+        return 1;
+
+    return pthread_setaffinity_np(worker->thread, sizeof(cpus), &cpus) != 0;
+#else
+    (void) worker;
+    (void) list;
+    return 1;
+#endif
+}
+
+/*
+ * Set the nice value of the calling thread. Raising a thread's priority
+ * (a negative value) usually needs privileges, without them the thread keeps
+ * running at the normal priority.
+ */
+static void
+worker_renice (const int nice)
+{
+#ifdef __linux__
+    /* on Linux the nice value belongs to the thread, not the process */
+    if (nice != 0)
+        setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), nice);
+#else
+    (void) nice;
+#endif
+}
+
+/*
+ * Where a Worker's thread starts. It pins itself first and then creates the
+ * Worker, so the Lua state and mailboxes are first touched, and placed by the
+ * kernel, on the NUMA node of the CPU it runs on.
+ */
+static void *
+worker_boot (void *arg)
+{
+    WorkerBoot *boot = arg;
+    Worker *worker = NULL;
+
+    worker_place(boot->id);
+    worker_renice(boot->nice);
+    worker = worker_create(boot->id);
+
+    pthread_mutex_lock(&boot->mutex);
+    boot->worker = worker;
+    boot->is_ready = 1;
+    pthread_cond_signal(&boot->cond);
+    pthread_mutex_unlock(&boot->mutex);
+
+    if (!worker)
+        return NULL;
+
+    return worker_thread(worker);
+}
+
+/*
+ * Create a Worker and start it, which spawns a thread. The Worker is created
+ * inside its own thread so its memory is local to the CPU it is pinned to.
+ * The thread runs at the `nice' value if it is allowed to, 0 leaves it as is.
  * Returns NULL on failure.
  */
 Worker *
-worker_start (const int id)
+worker_start (const int id, const int nice)
 {
-    Worker *worker = worker_create(id);
-    
-    if (!worker)
+    WorkerBoot boot;
+    pthread_t thread;
+
+    boot.id = id;
+    boot.nice = nice;
+    boot.is_ready = 0;
+    boot.worker = NULL;
+    pthread_mutex_init(&boot.mutex, NULL);
+    pthread_cond_init(&boot.cond, NULL);
+
+    if (pthread_create(&thread, NULL, worker_boot, &boot) != 0)
         goto exit;
 
-    pthread_create(&worker->thread, NULL, worker_thread, worker);
+    pthread_mutex_lock(&boot.mutex);
+    while (!boot.is_ready)
+        pthread_cond_wait(&boot.cond, &boot.mutex);
+    pthread_mutex_unlock(&boot.mutex);
+
+    if (!boot.worker)
+        pthread_join(thread, NULL);
 
 exit:
-    return worker;
+    pthread_mutex_destroy(&boot.mutex);
+    pthread_cond_destroy(&boot.cond);
+    return boot.worker;
 }
 
 /*
- * With an Action on top of L, check to see if the Worker's mailbox is ready 
- * to accept Actions. If it is, the Action is popped off L into the mailbox
- * and return 0. If it isn't, the Action isn't popped and returns 1.
+ * Where the new thread of a stopped Worker starts, see `worker_restart'.
+ */
+static void *
+worker_reboot (void *arg)
+{
+    Worker *worker = arg;
+
+    worker_place(worker->id);
+    return worker_thread(worker);
+}
+
+/*
+ * Start a new thread for the Worker which `worker_stop' stopped. It keeps
+ * its Lua state, mailboxes and Stats. A Worker which wasn't stopped is left
+ * as it is. Returns 0 if successful, 1 if the thread couldn't be created.
  */
 int
-worker_take_action (Worker *worker, lua_State *L)
+worker_restart (Worker *worker)
 {
-    int rc = pthread_mutex_trylock(&worker->mail_mutex);
-    if (rc == EBUSY || rc != 0)
+    if (!worker->is_stopped)
+        return 0;
+
+    if (pthread_create(&worker->thread, NULL, worker_reboot, worker) != 0)
         return 1;
-    utils_transfer(worker->M, L, 1);
-    pthread_mutex_unlock(&worker->mail_mutex);
+
+    worker->is_stopped = 0;
     return 0;
 }
 
 /*
- * Block and wait for the Worker's mailbox. Pop the Action off L onto the 
- * Worker's mailbox state. Returns 0 if successful.
+ * Push the Action into the Worker's shared mailbox. Idle Workers may steal it.
+ * This never blocks and the Worker owns the Action afterwards.
+ *
+ * Returns the number of shared Actions the Worker had before this one, which
+ * tells the caller whether the Worker is falling behind.
  */
 int
-worker_give_action (Worker *worker, lua_State *L)
+worker_take_action (Worker *worker, Action *action)
 {
-    if (pthread_mutex_lock(&worker->mail_mutex) != 0)
-        return 1;
-    utils_transfer(worker->M, L, 1);
-    pthread_mutex_unlock(&worker->mail_mutex);
-    return 0;
+    return worker_take_actions(worker, action, action, 1);
+}
+
+/*
+ * Push `count' Actions, linked from first to last, into the Worker's shared
+ * mailbox at once and wake the Worker once. Returns the number of shared
+ * Actions the Worker had before them, like `worker_take_action'.
+ */
+int
+worker_take_actions (Worker *worker, Action *first, Action *last, 
+        const int count)
+{
+    const int backlog = mailbox_count(worker->shared);
+    mailbox_push_chain(worker->shared, first, last, count);
+    worker_wake(worker);
+    return backlog;
+}
+
+/*
+ * Push the Action into the Worker's pinned mailbox, or its control mailbox if
+ * the Action has a high priority. Only this Worker will handle it. This never
+ * blocks and the Worker owns the Action afterwards.
+ */
+void
+worker_give_action (Worker *worker, Action *action)
+{
+    worker_give_actions(worker, action, action, 1);
+}
+
+/*
+ * Push `count' Actions of the same priority, linked from first to last, into
+ * the Worker's pinned (or control) mailbox at once and wake the Worker once.
+ * Like `worker_give_action' otherwise.
+ */
+void
+worker_give_actions (Worker *worker, Action *first, Action *last, 
+        const int count)
+{
+    if (first->priority == ACTION_HIGH)
+        mailbox_push_chain(worker->control, first, last, count);
+    else
+        mailbox_push_chain(worker->pinned, first, last, count);
+
+    worker_wake(worker);
+}
+
+/*
+ * The number of Actions queued for the Worker, in every mailbox and in the
+ * queues of the Actors they were dispatched to it for (see
+ * `worker_count_queued').
+ */
+int
+worker_backlog (Worker *worker)
+{
+    return mailbox_count(worker->control) + mailbox_count(worker->pinned) 
+        + mailbox_count(worker->shared) 
+        + __atomic_load_n(&worker->queued, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Count `count' more Actions queued in an Actor's inbox for the Worker, or
+ * fewer if it is negative. Whichever Worker runs the Actor, the Actions are
+ * part of the backlog of the Worker they were dispatched to.
+ */
+void
+worker_count_queued (Worker *worker, const int count)
+{
+    __atomic_add_fetch(&worker->queued, count, __ATOMIC_ACQ_REL);
+}
+
+/*
+ * Throw away the oldest normal Action of the Worker's pinned (or shared)
+ * mailbox the next time it is popped from, making room for a newer one.
+ * Only the mailbox's consumer may pop, so it does the throwing away.
+ */
+void
+worker_drop_oldest (Worker *worker, const int is_pinned)
+{
+    if (is_pinned)
+        __atomic_add_fetch(&worker->dropping_pinned, 1, __ATOMIC_ACQ_REL);
+    else
+        __atomic_add_fetch(&worker->dropping_shared, 1, __ATOMIC_ACQ_REL);
+}
+
+/*
+ * Returns the Worker running on the calling thread or NULL if the caller
+ * isn't a Worker (e.g. the main thread).
+ */
+Worker *
+worker_self ()
+{
+    return current_worker;
+}
+
+/*
+ * The Worker's id, which is its index in the Director's list of Workers.
+ */
+int
+worker_id (Worker *worker)
+{
+    return worker->id;
+}
+
+/*
+ * The Worker's Lua state. Only the Worker's own thread may use it.
+ */
+lua_State *
+worker_state (Worker *worker)
+{
+    return worker->L;
+}
+
+/*
+ * Copy the Worker's Stats into `stats', along with how many Actions are
+ * queued for it right now.
+ */
+void
+worker_stats (Worker *worker, Stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats_merge(stats, worker->stats);
+    stats->depth = worker_backlog(worker);
+}
+
+/*
+ * Steal the oldest shared Action from the Worker. Doesn't wait if another
+ * Worker is already taking from it. Returns NULL if there was nothing to 
+ * steal.
+ */
+Action *
+worker_steal_action (Worker *worker)
+{
+    Action *action = NULL;
+
+    if (mailbox_count(worker->shared) == 0)
+        goto exit;
+
+    if (pthread_mutex_trylock(&worker->steal_mutex) != 0)
+        goto exit;
+
+    action = worker_pop(worker->shared, &worker->dropping_shared);
+    pthread_mutex_unlock(&worker->steal_mutex);
+
+exit:
+    return action;
 }
 
 /*
  * Wait for the Worker to wait for work, then join it back to the main thread.
+ * The sentinel is queued behind any Actions already pinned to the Worker, so
+ * those are handled before the Worker stops. A Worker run by the calling
+ * thread itself (see `worker_pump') has nothing to join, its Actions are
+ * dropped when it is cleaned up.
  */
 void
 worker_stop (Worker *worker)
 {
-    pthread_mutex_lock(&worker->mail_mutex);
-    lua_pushnil(worker->M); /* it checks for nil as a sentinel to stop */
-    pthread_mutex_unlock(&worker->mail_mutex);
+    Action *sentinel = NULL;
+
+    if (worker->is_stopped || pthread_equal(worker->thread, pthread_self()))
+        return;
+
+    sentinel = action_create_empty();
+
+    /* without memory for a sentinel there's no clean way to stop the thread */
+    if (!sentinel)
+        return;
+
+    worker_give_action(worker, sentinel);
     pthread_join(worker->thread, NULL);
+    worker->is_stopped = 1;
+}
+
+/*
+ * Move what the stopped Worker still has queued to the heir: its shared
+ * Actions and every run token go into the heir's shared mailbox. Returns the
+ * rest, which only it could handle, linked in a chain (NULL if there are
+ * none) for the caller to throw away.
+ */
+Action *
+worker_hand_over (Worker *worker, Worker *heir)
+{
+    Action *action = NULL, *left = NULL;
+
+    while ((action = mailbox_pop(worker->shared)))
+        worker_take_action(heir, action);
+
+    while ((action = mailbox_pop(worker->control)) 
+            || (action = mailbox_pop(worker->pinned))) {
+        if (director_run_token(action) > -1) {
+            worker_take_action(heir, action);
+        } else {
+            action->next = left;
+            left = action;
+        }
+    }
+
+    return left;
 }
 
 /*
@@ -231,16 +1157,19 @@ worker_cleanup (Worker *worker)
 {
     /* 
      * Wait for the state first because it will only become unlocked after the
-     * thread is done. this makes it safe for us to then destroy the mailbox
-     * state afterwards.
+     * thread is done. this makes it safe for us to then destroy the mailboxes
+     * afterwards.
      */
     pthread_mutex_lock(&worker->state_mutex);
     lua_close(worker->L);
     pthread_mutex_unlock(&worker->state_mutex);
 
-    pthread_mutex_lock(&worker->mail_mutex);
-    lua_close(worker->M);
-    pthread_mutex_unlock(&worker->mail_mutex);
+    mailbox_destroy(worker->control);
+    mailbox_destroy(worker->pinned);
+    mailbox_destroy(worker->shared);
+    pthread_cond_destroy(&worker->mail_cond);
 
+    free(worker->batch_actions);
+    stats_destroy(worker->stats);
     free(worker);
 }
@@ -2,9 +2,27 @@
 #define DIALOGUE_WORKER
 
 #include "dialogue.h"
+#include "action.h"
+#include "stats.h"
 
 typedef struct Worker Worker;
 
+/*
+ * Pin the calling thread to the CPU of the Worker with the id: the id'th CPU
+ * of the `-a' list, wrapping around if there are more Workers than CPUs. Does
+ * nothing if no list was given.
+ */
+void
+worker_place (const int id);
+
+/*
+ * Pin the Worker's thread to the CPUs in a list like "0-3,8". Memory it has
+ * already touched stays where it is. Returns 0 if successful, 1 if the list
+ * is malformed or pinning isn't supported.
+ */
+int
+worker_pin (Worker *worker, const char *list);
+
 /*
  * Create a worker without a thread. Assigns the thread to main if it isn't 
  * null. Returns NULL on failure.
@@ -13,36 +31,160 @@ Worker *
 worker_create (const int id);
 
 /*
- * Create a Worker and start it, which spawns a thread.
+ * Create a Worker and start it, which spawns a thread. The Worker is created
+ * inside its own thread so its memory is local to the CPU it is pinned to.
+ * The thread runs at the `nice' value if it is allowed to, 0 leaves it as is.
  * Returns NULL on failure.
  */
 Worker *
-worker_start (const int id);
+worker_start (const int id, const int nice);
+
+/*
+ * Start a new thread for the Worker which `worker_stop' stopped. It keeps
+ * its Lua state, mailboxes and Stats. A Worker which wasn't stopped is left
+ * as it is. Returns 0 if successful, 1 if the thread couldn't be created.
+ */
+int
+worker_restart (Worker *worker);
 
 void*
 worker_thread (void *arg);
 
 /*
- * With an Action on top of L, check to see if the Worker's mailbox is ready 
- * to accept Actions. If it is, the Action is popped off L into the mailbox
- * and return 0. If it isn't, the Action isn't popped and returns 1.
+ * Handle the Worker's Actions on the calling thread without ever waiting for
+ * more, which is how a Worker without a thread of its own is run from a
+ * host's loop (see `director_pump'). Batches are drained and handled until
+ * nothing is queued, `max_actions' Actions have been taken or `max_ms'
+ * milliseconds have passed, where 0 is no limit. The time is checked between
+ * batches, so a slow handler can run over it.
+ *
+ * Returns the number of Actions taken, or -1 if another thread is running
+ * the Worker (or this one already is, further up its stack).
+ */
+int
+worker_pump (Worker *worker, const int max_ms, const int max_actions);
+
+/*
+ * Push the Action into the Worker's shared mailbox. Idle Workers may steal it.
+ * This never blocks and the Worker owns the Action afterwards.
+ *
+ * Returns the number of shared Actions the Worker had before this one, which
+ * tells the caller whether the Worker is falling behind.
  */
 int
-worker_take_action (Worker *worker, lua_State *L);
+worker_take_action (Worker *worker, Action *action);
 
 /*
- * Block and wait for the Worker's mailbox. Pop the Action off L onto the 
- * Worker's mailbox state. Returns 0 if successful.
+ * Push `count' Actions, linked from first to last, into the Worker's shared
+ * mailbox at once and wake the Worker once. Returns the number of shared
+ * Actions the Worker had before them, like `worker_take_action'.
  */
 int
-worker_give_action (Worker *worker, lua_State *L);
+worker_take_actions (Worker *worker, Action *first, Action *last, 
+        const int count);
+
+/*
+ * Push the Action into the Worker's pinned mailbox, or its control mailbox if
+ * the Action has a high priority. Only this Worker will handle it. This never
+ * blocks and the Worker owns the Action afterwards.
+ */
+void
+worker_give_action (Worker *worker, Action *action);
+
+/*
+ * Push `count' Actions of the same priority, linked from first to last, into
+ * the Worker's pinned (or control) mailbox at once and wake the Worker once.
+ * Like `worker_give_action' otherwise.
+ */
+void
+worker_give_actions (Worker *worker, Action *first, Action *last, 
+        const int count);
+
+/*
+ * The number of Actions queued for the Worker, in every mailbox and in the
+ * queues of the Actors they were dispatched to it for (see
+ * `worker_count_queued').
+ */
+int
+worker_backlog (Worker *worker);
+
+/*
+ * Count `count' more Actions queued in an Actor's inbox for the Worker, or
+ * fewer if it is negative. Whichever Worker runs the Actor, the Actions are
+ * part of the backlog of the Worker they were dispatched to.
+ */
+void
+worker_count_queued (Worker *worker, const int count);
+
+/*
+ * Throw away the oldest normal Action of the Worker's pinned (or shared)
+ * mailbox the next time it is popped from, making room for a newer one.
+ * Only the mailbox's consumer may pop, so it does the throwing away.
+ */
+void
+worker_drop_oldest (Worker *worker, const int is_pinned);
+
+/*
+ * Returns the Worker running on the calling thread or NULL if the caller
+ * isn't a Worker (e.g. the main thread).
+ */
+Worker *
+worker_self ();
+
+/*
+ * The Worker's id, which is its index in the Director's list of Workers.
+ */
+int
+worker_id (Worker *worker);
+
+/*
+ * The Worker's Lua state. Only the Worker's own thread may use it.
+ */
+lua_State *
+worker_state (Worker *worker);
+
+/*
+ * Copy the Worker's Stats into `stats', along with how many Actions are
+ * queued for it right now.
+ */
+void
+worker_stats (Worker *worker, Stats *stats);
+
+/*
+ * Steal the oldest shared Action from the Worker. Doesn't wait if another
+ * Worker is already taking from it. Returns NULL if there was nothing to 
+ * steal.
+ */
+Action *
+worker_steal_action (Worker *worker);
+
+/*
+ * Wake the Worker if it is parked, either because an Action has been pushed
+ * to it or so it can look for Actions to steal. Returns 0 if the Worker was
+ * parked, 1 otherwise.
+ */
+int
+worker_wake (Worker *worker);
 
 /*
  * Wait for the Worker to wait for work, then join it back to the main thread.
+ * The sentinel is queued behind any Actions already pinned to the Worker, so
+ * those are handled before the Worker stops. A Worker run by the calling
+ * thread itself (see `worker_pump') has nothing to join, its Actions are
+ * dropped when it is cleaned up.
  */
 void
 worker_stop (Worker *worker);
 
+/*
+ * Move what the stopped Worker still has queued to the heir: its shared
+ * Actions and every run token go into the heir's shared mailbox. Returns the
+ * rest, which only it could handle, linked in a chain (NULL if there are
+ * none) for the caller to throw away.
+ */
+Action *
+worker_hand_over (Worker *worker, Worker *heir);
+
 /*
  * Frees the worker.
  */
@@ -2,6 +2,9 @@ Coordinate = require ("Coordinate")
 Ball = {}
 Ball.__index = Ball
 
+-- only the newest position and draw request of a frame matter
+Ball.coalesce = {"draw", "position"}
+
 function Ball.new (x, y)
    local table = {}
    setmetatable(table, Ball)
@@ -9,7 +9,7 @@ function Graphics:register (definition, author)
     self.to_draw[author] = definition
 end
 
--- The main `loop` of the game purely by recursive message
+-- The main `loop` of the game purely by a recursive, timed message
 function Graphics:main ()
     if self.window:per_second(30) then
         actor:command{"update"}
@@ -19,8 +19,8 @@ function Graphics:main ()
     actor:command{"draw"}
     self:_render()
     
-    -- recursive :^)
-    actor:think{"main"}
+    -- recursive :^) about 60 times a second, without keeping a worker busy
+    actor:after(16, {"main"})
 end
 
 -- Actually draw the definitions registered
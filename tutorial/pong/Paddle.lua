@@ -1,6 +1,9 @@
 Paddle = {}
 Paddle.__index = Paddle
 
+-- only the newest position and draw request of a frame matter
+Paddle.coalesce = {"draw", "position"}
+
 function Paddle.new (x, y)
    local table = {}
    setmetatable(table, Paddle)